@@ -0,0 +1,56 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+// Minimal helpers for the microbenchmarks in this directory, see "make bench".
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+// keep the compiler from optimizing a result away
+template<typename T>
+inline void keep(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Call f(i) with i = 0, 1, ... until about 200ms have passed,
+// print and return the time per call in ns.
+template<typename F>
+double measure(const char *name, F &&f)
+{
+    using clock = std::chrono::steady_clock;
+    for (std::size_t n = 1;; n *= 2)
+    {
+        const auto start = clock::now();
+        for (std::size_t i = 0; i < n; i++)
+            f(i);
+        const std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+        if (elapsed.count() >= 2e8)
+        {
+            const auto ns = elapsed.count() / n;
+            std::printf("  %-40s %10.1f ns\n", name, ns);
+            return ns;
+        }
+    }
+}
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,166 @@
+#!/bin/sh
+# Functional checks of the proxy against the fake PDU, reading the counters
+# of /metrics. Builds a proxy with a configuration for the fake PDU, like
+# bench/load.sh, and the checks in bench/ that run against the fake PDU
+# themselves. Exits with 1, if a check fails.
+#
+# usage: bench/check.sh
+#   CXX, e.g. CXX="g++ -fpermissive", selects the compiler
+
+set -e
+cd "$(dirname "$0")/.."
+
+CXX=${CXX:-c++}
+
+pdu_port=18082
+proxy_port=18193
+proxy_url=http://127.0.0.1:$proxy_port
+tmp=$(mktemp -d)
+pdu=
+proxy=
+cleanup()
+{
+    [ -n "$proxy" ] && kill "$proxy" 2>/dev/null || true
+    [ -n "$pdu" ] && kill "$pdu" 2>/dev/null || true
+    rm -rf "$tmp"
+}
+trap cleanup EXIT INT TERM
+
+# config.h is looked up next to power-switch.cpp first, so build a copy
+sed -e 's/<ip addr or hostname>/127.0.0.1/' \
+    -e "s/const std::string port{\"80\"}/const std::string port{\"$pdu_port\"}/" \
+    -e "s/^#define PROXY_BIND_PORT .*/#define PROXY_BIND_PORT $proxy_port/" \
+    -e 's/^#define PROXY_BIND_ADDR .*/#define PROXY_BIND_ADDR "127.0.0.1"/' \
+    -e 's/{"ch8", ch8}/{"c\\"h\\\\8", ch8}/' \
+    config-template.h > "$tmp/config.h"
+cp power-switch.cpp "$tmp/"
+mkdir "$tmp/bench"
+cp bench/queue_wait.cpp "$tmp/bench/"
+echo "building ..."
+$CXX -O2 -std=c++20 -I. -Ilib/boost/ -Ilib/rapidxml-2.0.5 "$tmp/power-switch.cpp" -o "$tmp/power-switch" -pthread
+$CXX -O2 -std=c++20 -I. -Ilib/boost/ -Ilib/rapidxml-2.0.5 "$tmp/bench/queue_wait.cpp" -o "$tmp/queue_wait" -pthread
+
+python3 bench/fakepdu.py $pdu_port &
+pdu=$!
+"$tmp/power-switch" proxy > "$tmp/proxy.log" 2>&1 &
+proxy=$!
+sleep 1
+
+failed=0
+
+# value of a counter in /metrics
+metric()
+{
+    curl -s "$proxy_url/metrics" | sed -n "s/^$1 //p"
+}
+
+# state of a channel as the fake PDU has it: on or off
+pdu_state()
+{
+    curl -s "http://127.0.0.1:$pdu_port/status.xml" | sed -n "s|.*<outletStat$1>\(.*\)</outletStat$1>.*|\1|p"
+}
+
+# check <description> <condition>...
+check()
+{
+    description=$1
+    shift
+    if "$@"; then
+        echo "ok      $description"
+    else
+        echo "FAILED  $description"
+        failed=1
+    fi
+}
+
+# A fresh read after switching does not join a status request sent before.
+# The fake PDU answers status.xml after 1s here, with the states from before.
+# This runs first, before the proxy has the latencies to hedge status
+# requests: two slow attempts would hold the scheduler and delay the switch.
+curl -s "http://127.0.0.1:$pdu_port/delay?ms=1000" > /dev/null
+curl -s "$proxy_url/show?fresh=1" > /dev/null &
+reader=$!
+sleep 0.3
+curl -s "$proxy_url/ch5?on" > /dev/null
+check "fresh read after switching shows the switch" sh -c "curl -s '$proxy_url/show?fresh=1' | grep -q '^ch5: on'"
+wait $reader
+curl -s "http://127.0.0.1:$pdu_port/delay?ms=0" > /dev/null
+
+# A repeated command is not sent to the PDU, once a poll has confirmed the
+# state of its channel. Polling is fast after switching, see STATUS_POLL.
+curl -s "$proxy_url/ch1?on" > /dev/null
+sleep 2
+elided=$(metric switch_elided)
+curl -s "$proxy_url/ch1?on" > /dev/null
+check "repeated command is elided" [ "$(metric switch_elided)" -gt "$elided" ]
+
+# A power cycle (5s off) is not merged with other commands. A command for its
+# channel during the off time takes effect, the cycle still ends with "on".
+curl -s "$proxy_url/ch2?on" > /dev/null
+curl -s "$proxy_url/ch2?cycle" > /dev/null &
+cycle=$!
+sleep 1
+check "channel is off during a power cycle" [ "$(pdu_state 1)" = off ]
+curl -s "$proxy_url/ch2?on" > /dev/null
+check "command during a power cycle takes effect" [ "$(pdu_state 1)" = on ]
+curl -s "$proxy_url/ch2?off" > /dev/null
+wait $cycle
+check "power cycle ends with its channel on" [ "$(pdu_state 1)" = on ]
+
+# A client going away while a power cycle of /api/v1 waits does not keep its
+# session, but its channel is still turned on again after the duration.
+sessions=$(metric admission_sessions)
+curl -s --max-time 1 -d '{"operations": [{"op": "cycle", "channels": ["ch3"], "duration_ms": 3000}]}' "$proxy_url/api/v1" > /dev/null || true
+sleep 1
+check "session of a batch is closed with its client" [ "$(metric admission_sessions)" -le "$sessions" ]
+check "channel is off during the power cycle of a batch" [ "$(pdu_state 2)" = off ]
+sleep 2
+check "power cycle of a batch ends with its channel on" [ "$(pdu_state 2)" = on ]
+
+# The same with a client, that pipelined another request behind the batch.
+# It connects from another address, so that it has its own rate limit.
+sessions=$(metric admission_sessions)
+python3 - $proxy_port <<'EOF'
+import socket, sys, time
+body = b'{"operations": [{"op": "cycle", "channels": ["ch3"], "duration_ms": 3000}]}'
+s = socket.create_connection(('127.0.0.1', int(sys.argv[1])), source_address=('127.0.0.2', 0))
+s.sendall(b'POST /api/v1 HTTP/1.1\r\nHost: proxy\r\nContent-Length: %d\r\n\r\n' % len(body) + body)
+time.sleep(0.5)
+s.sendall(b'GET /show HTTP/1.1\r\nHost: proxy\r\n\r\n')
+time.sleep(0.5)
+s.close()
+EOF
+sleep 1
+check "session of a batch with a pipelined request is closed with its client" [ "$(metric admission_sessions)" -le "$sessions" ]
+sleep 2
+check "power cycle of that batch ends with its channel on" [ "$(pdu_state 2)" = on ]
+
+# A power cycle sent via /ws takes duration_ms like /api/v1
+start=$(date +%s)
+answer=$(python3 bench/ws_command.py $proxy_port "ch4 cycle duration_ms=2000" c1)
+elapsed=$(($(date +%s) - start))
+check "power cycle of /ws is answered" [ "$answer" = "ok c1" ]
+check "power cycle of /ws takes its duration_ms" [ $elapsed -ge 2 ]
+check "duration_ms of /ws is checked" [ "$(python3 bench/ws_command.py $proxy_port "ch4 cycle duration_ms=600001" c2)" = "error c2 invalid duration_ms" ]
+
+# The hedge delay is derived from the latencies of the PDU, not from the time
+# requests waited for the scheduler, see bench/queue_wait.cpp.
+check "hedge delay excludes queue wait" "$tmp/queue_wait"
+
+# /events sends the switch states as JSON, even with a channel named c"h\8,
+# and the state of the circuit breaker as a named event
+curl -sN --max-time 2 "$proxy_url/events" > "$tmp/events" || true
+check "events are valid JSON" python3 -c "
+import json, sys
+data = [line[6:] for line in open(sys.argv[1]) if line.startswith('data: ')]
+states = json.loads(data[0])
+sys.exit(not (states['c\"h\\\\8'] in ('on', 'off') and all(json.loads(d) for d in data)))" "$tmp/events"
+check "events report the circuit breaker" sh -c "grep -A1 '^event: breaker' '$tmp/events' | grep -q '^data: \"closed\"'"
+
+# /limits writes rates in fixed notation, not like 2E-1
+limits=$(curl -s "$proxy_url/limits")
+echo "        $limits"
+check "limits are valid JSON" sh -c "echo '$limits' | python3 -m json.tool > /dev/null"
+check "limits are written in fixed notation" sh -c "echo '$limits' | grep -q '\"cycle\":{\"rate\":0.2,\"burst\":2}'"
+
+exit $failed
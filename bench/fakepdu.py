@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+# Fake PDU for bench/load.sh: answers status.xml and control_outlet.htm like
+# the real device, with keep-alive connections and without authentication.
+# /delay?ms=<ms> delays the answers to status.xml, they still show the states
+# from when the request arrived.
+# usage: fakepdu.py [<port>]
+
+import http.server
+import socketserver
+import sys
+import time
+import urllib.parse
+
+state = [False] * 8
+status_delay = 0.0
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, *args):
+        pass
+
+    def do_GET(self):
+        global status_delay
+        url = urllib.parse.urlparse(self.path)
+        if url.path == '/status.xml':
+            body = '<?xml version="1.0"?>\n<response>\n' + ''.join(
+                '<outletStat%d>%s</outletStat%d>\n' % (ch, 'on' if on else 'off', ch) for ch, on in enumerate(state)) + '</response>\n'
+            time.sleep(status_delay)
+        elif url.path == '/delay':
+            status_delay = int(urllib.parse.parse_qs(url.query)['ms'][0]) / 1000
+            body = 'ok'
+        elif url.path == '/control_outlet.htm':
+            query = urllib.parse.parse_qs(url.query)
+            op = int(query['op'][0])
+            for ch in range(8):
+                if 'outlet%d' % ch in query:
+                    state[ch] = op == 0
+            body = 'ok'
+        else:
+            self.send_response(404)
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+
+        data = body.encode()
+        self.send_response(200)
+        self.send_header('Content-Type', 'text/xml')
+        self.send_header('Content-Length', str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+Server(('127.0.0.1', int(sys.argv[1]) if len(sys.argv) > 1 else 8081), Handler).serve_forever()
@@ -0,0 +1,176 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// HTTP load generator for bench/load.sh: keeps a number of keep-alive
+// connections busy with GET requests for a while and prints the throughput
+// and latency percentiles. Connections closed by the server are reopened.
+// usage: http_load <host> <port> <target> <connections> <seconds> [<threads>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+namespace http = boost::beast::http;
+
+static std::atomic<bool> stopped{false};
+
+class connection: public std::enable_shared_from_this<connection>
+{
+public:
+    connection(boost::asio::io_context &io_context, const boost::asio::ip::tcp::resolver::results_type &endpoints, const std::string &host, const std::string &target):
+        stream{boost::asio::make_strand(io_context)},
+        endpoints{endpoints}
+    {
+        request = {http::verb::get, target, 11};
+        request.set(http::field::host, host);
+        request.keep_alive(true);
+    }
+
+    void start()
+    {
+        stream.async_connect(endpoints, [This = shared_from_this()](auto ec, const auto &) {
+            if (ec)
+                return This->failed();
+            This->send();
+        });
+    }
+
+    std::vector<double> latencies;  // in microseconds
+    std::uint64_t       errors      = 0;
+    std::uint64_t       connections = 1;
+
+private:
+    void send()
+    {
+        if (stopped)
+            return;
+        sent = std::chrono::steady_clock::now();
+        http::async_write(stream, request, [This = shared_from_this()](auto ec, auto) {
+            if (ec)
+                return This->failed();
+            This->response = {};
+            http::async_read(This->stream, This->buffer, This->response, [This](auto ec, auto) {
+                if (ec)
+                    return This->failed();
+                if (This->response.result() == http::status::ok)
+                    This->latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - This->sent).count());
+                else
+                    This->errors++;
+                if (!This->response.keep_alive())
+                    return This->reconnect();
+                This->send();
+            });
+        });
+    }
+
+    void failed()
+    {
+        if (stopped)
+            return;
+        errors++;
+        reconnect();
+    }
+
+    void reconnect()
+    {
+        boost::system::error_code ec;
+        stream.socket().close(ec);
+        buffer.clear();
+        connections++;
+        start();
+    }
+
+    boost::beast::tcp_stream                             stream;
+    boost::asio::ip::tcp::resolver::results_type         endpoints;
+    http::request<http::empty_body>                      request;
+    http::response<http::string_body>                    response;
+    boost::beast::flat_buffer                            buffer;
+    std::chrono::steady_clock::time_point                sent;
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 6)
+    {
+        std::fprintf(stderr, "usage: %s <host> <port> <target> <connections> <seconds> [<threads>]\n", argv[0]);
+        return 1;
+    }
+    const std::string host   = argv[1];
+    const std::string port   = argv[2];
+    const std::string target = argv[3];
+    const int connections    = std::atoi(argv[4]);
+    const int seconds        = std::atoi(argv[5]);
+    const int threads        = argc > 6 ? std::atoi(argv[6]) : 1;
+
+    boost::asio::io_context io_context;
+    const auto endpoints = boost::asio::ip::tcp::resolver{io_context}.resolve(host, port);
+
+    std::vector<std::shared_ptr<connection>> clients;
+    for (int i = 0; i < connections; i++)
+    {
+        clients.push_back(std::make_shared<connection>(io_context, endpoints, host, target));
+        clients.back()->start();
+    }
+
+    boost::asio::steady_timer timer{io_context, std::chrono::seconds(seconds)};
+    timer.async_wait([&](auto) {
+        stopped = true;
+        io_context.stop();
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; i++)
+        pool.emplace_back([&io_context]() { io_context.run(); });
+    io_context.run();
+    for (auto &thread:pool)
+        thread.join();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> latencies;
+    std::uint64_t errors = 0, reconnects = 0;
+    for (const auto &client:clients)
+    {
+        latencies.insert(latencies.end(), client->latencies.begin(), client->latencies.end());
+        errors     += client->errors;
+        reconnects += client->connections - 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, std::size_t(p * latencies.size()))];
+    };
+
+    std::printf("%10.0f req/s  p50 %8.0f us  p99 %8.0f us  errors %llu  reconnects %llu\n",
+        latencies.size() / elapsed, percentile(0.5), percentile(0.99),
+        static_cast<unsigned long long>(errors), static_cast<unsigned long long>(reconnects));
+    return 0;
+}
@@ -0,0 +1,110 @@
+#!/bin/sh
+# Load test of the proxy against a fake PDU, to compare the threading modes:
+# a thread pool (--threads) and shards with their own acceptors (--shards).
+# Builds a proxy with a configuration for the fake PDU and without rate
+# limits, then runs the HTTP and the WebSocket load generators against
+# each mode in turn. The WebSocket load generator runs against a proxy with
+# the default limits of config-template.h as well.
+#
+# usage: bench/load.sh [<seconds>] [<connections>] [<target>]
+#   target defaults to /show, which is answered from the status model
+#   CXX, e.g. CXX="g++ -fpermissive", selects the compiler
+#   THREADS lists the thread and shard counts to compare, default 1 2 4 ... nproc
+#   MODES selects the modes, default "threads shards"
+#   WS_CONNECTIONS and WS_DEPTH: /ws command channels and commands in flight
+#   on each, default 8 and 16
+
+set -e
+cd "$(dirname "$0")/.."
+
+seconds=${1:-10}
+connections=${2:-64}
+target=${3:-/show}
+CXX=${CXX:-c++}
+MODES=${MODES:-threads shards}
+WS_CONNECTIONS=${WS_CONNECTIONS:-8}
+WS_DEPTH=${WS_DEPTH:-16}
+
+cpus=$(nproc 2>/dev/null || sysctl -n hw.ncpu)
+if [ -z "$THREADS" ]; then
+    THREADS=1
+    n=2
+    while [ $n -le "$cpus" ]; do
+        THREADS="$THREADS $n"
+        n=$((n * 2))
+    done
+fi
+
+pdu_port=18081
+proxy_port=18192
+tmp=$(mktemp -d)
+pdu=
+proxy=
+cleanup()
+{
+    [ -n "$proxy" ] && kill "$proxy" 2>/dev/null || true
+    [ -n "$pdu" ] && kill "$pdu" 2>/dev/null || true
+    rm -rf "$tmp"
+}
+trap cleanup EXIT INT TERM
+
+# config.h is looked up next to power-switch.cpp first, so build copies:
+# $tmp without limits, $tmp/limited with the default limits
+mkdir "$tmp/limited"
+sed -e 's/<ip addr or hostname>/127.0.0.1/' \
+    -e "s/const std::string port{\"80\"}/const std::string port{\"$pdu_port\"}/" \
+    -e "s/^#define PROXY_BIND_PORT .*/#define PROXY_BIND_PORT $proxy_port/" \
+    -e 's/^#define PROXY_BIND_ADDR .*/#define PROXY_BIND_ADDR "127.0.0.1"/' \
+    config-template.h > "$tmp/limited/config.h"
+sed -e 's/^#define PROXY_MAX_SESSIONS .*/#define PROXY_MAX_SESSIONS 65535/' \
+    -e 's/^#define PROXY_MAX_SESSIONS_PER_CLIENT .*/#define PROXY_MAX_SESSIONS_PER_CLIENT 65535/' \
+    -e 's/^#define PROXY_RATE_\([A-Z]*\) .*/#define PROXY_RATE_\1 { 0, 0 }/' \
+    "$tmp/limited/config.h" > "$tmp/config.h"
+cp power-switch.cpp "$tmp/"
+cp power-switch.cpp "$tmp/limited/"
+echo "building ..."
+$CXX -O2 -std=c++20 -I. -Ilib/boost/ -Ilib/rapidxml-2.0.5 "$tmp/power-switch.cpp" -o "$tmp/power-switch" -pthread
+$CXX -O2 -std=c++20 -I. -Ilib/boost/ -Ilib/rapidxml-2.0.5 "$tmp/limited/power-switch.cpp" -o "$tmp/limited/power-switch" -pthread
+$CXX -O2 -std=c++20 -Ilib/boost/ bench/http_load.cpp -o "$tmp/http_load" -pthread
+$CXX -O2 -std=c++20 -Ilib/boost/ bench/ws_load.cpp -o "$tmp/ws_load" -pthread
+
+python3 bench/fakepdu.py $pdu_port &
+pdu=$!
+
+# run a load generator against: proxy --<mode> <n>
+# usage: run <http|ws> <mode> <n> [<directory of the proxy>]
+run()
+{
+    "${4:-$tmp}/power-switch" proxy --"$2" "$3" > "$tmp/proxy.log" 2>&1 &
+    proxy=$!
+    sleep 1
+    printf '%-14s' "--$2 $3"
+    case $1 in
+        http) "$tmp/http_load" 127.0.0.1 $proxy_port "$target" "$connections" "$seconds" "$cpus" ;;
+        ws)   "$tmp/ws_load" 127.0.0.1 $proxy_port "$WS_CONNECTIONS" "$WS_DEPTH" "$seconds" "$cpus" ;;
+    esac
+    kill "$proxy"
+    wait "$proxy" 2>/dev/null || true
+    proxy=
+}
+
+echo "GET $target, $connections connections, ${seconds}s, $cpus CPUs"
+for mode in $MODES; do
+    for n in $THREADS; do
+        run http "$mode" "$n"
+    done
+done
+
+echo "/ws switch commands, $WS_CONNECTIONS connections, $WS_DEPTH in flight each, ${seconds}s"
+for mode in $MODES; do
+    for n in $THREADS; do
+        run ws "$mode" "$n"
+    done
+done
+
+echo "/ws switch commands with the default limits, $WS_CONNECTIONS connections, $WS_DEPTH in flight each, ${seconds}s"
+for mode in $MODES; do
+    for n in $THREADS; do
+        run ws "$mode" "$n" "$tmp/limited"
+    done
+done
@@ -0,0 +1,192 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Looking up the names of a proxy request: routes and channels, scenes and
+// commands in their perfect hash tables against std::maps with
+// case-insensitive compare, as the names were looked up before. Every name
+// is looked up in several spellings, a quarter of the lookups do not match.
+// The same is done for a table as large as one for a long list of scenes.
+
+#define main power_switch_main
+#include "../power-switch.cpp"
+#undef main
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <random>
+
+#include "bench.h"
+
+enum class table_t { route, scene, command };
+
+struct lookup
+{
+    table_t     table;
+    std::string name;
+};
+
+// name in lower, upper and mixed case, and a name of the same length that does not match
+static void add_spellings(std::vector<lookup> &lookups, table_t table, std::string_view key)
+{
+    std::string lower{key}, upper{key}, mixed{key}, miss{key};
+    for (std::size_t i = 0; i < key.size(); i++)
+    {
+        const auto c = static_cast<unsigned char>(key[i]);
+        lower[i] = char(std::tolower(c));
+        upper[i] = char(std::toupper(c));
+        mixed[i] = char(i % 2 ? std::toupper(c) : std::tolower(c));
+    }
+    miss.back() = miss.back() == '~' ? '_' : '~';
+
+    for (auto &name:{lower, upper, mixed, miss})
+        lookups.push_back({table, name});
+}
+
+// shuffled, so neither side profits from looking up the same name again and again
+static void shuffle(std::vector<lookup> &lookups)
+{
+    std::mt19937 random{1};
+    std::shuffle(lookups.begin(), lookups.end(), random);
+}
+
+static void configured_tables()
+{
+    std::map<std::string_view, route, case_insensitive>        routes;
+    std::map<std::string_view, const scene*, case_insensitive> scene_map;
+    std::map<std::string_view, command_t, case_insensitive>    commands;
+
+    std::vector<lookup> lookups;
+    for (const auto &entry:route_table)
+    {
+        routes.emplace(entry.key, entry.value);
+        add_spellings(lookups, table_t::route, entry.key);
+    }
+    for (const auto &entry:scene_table)
+    {
+        scene_map.emplace(entry.key, entry.value);
+        add_spellings(lookups, table_t::scene, entry.key);
+    }
+    for (const auto &entry:command_table)
+    {
+        commands.emplace(entry.key, entry.value);
+        add_spellings(lookups, table_t::command, entry.key);
+    }
+    shuffle(lookups);
+
+    std::printf("name lookup, %zu routes, %zu scenes, %zu commands, %zu names, 1/4 not matching:\n",
+        routes.size(), scene_map.size(), commands.size(), lookups.size());
+    const auto tree = measure("std::map, case_insensitive", [&](std::size_t i) {
+        const auto &item = lookups[i % lookups.size()];
+        switch (item.table)
+        {
+            case table_t::route:
+            {
+                const auto it = routes.find(item.name);
+                return keep(it != routes.end() ? int(it->second.type) : -1);
+            }
+            case table_t::scene:
+            {
+                const auto it = scene_map.find(item.name);
+                return keep(it != scene_map.end() ? it->second : nullptr);
+            }
+            case table_t::command:
+            {
+                const auto it = commands.find(item.name);
+                return keep(it != commands.end() ? int(it->second) : -1);
+            }
+        }
+    });
+    const auto hash = measure("perfect_hash", [&](std::size_t i) {
+        const auto &item = lookups[i % lookups.size()];
+        switch (item.table)
+        {
+            case table_t::route:
+            {
+                const auto r = route_table.find(item.name);
+                return keep(r ? int(r->type) : -1);
+            }
+            case table_t::scene:
+            {
+                const auto s = scene_table.find(item.name);
+                return keep(s ? *s : nullptr);
+            }
+            case table_t::command:
+            {
+                const auto c = command_table.find(item.name);
+                return keep(c ? int(*c) : -1);
+            }
+        }
+    });
+    std::printf("  speedup %.1fx\n", tree / hash);
+}
+
+// all configured names and generated ones, like the scene table of a
+// configuration with many scenes
+static void large_table()
+{
+    constexpr std::size_t size = 64;
+
+    std::vector<std::string> names;
+    for (const auto &entry:route_table)
+        names.emplace_back(entry.key);
+    for (const auto &entry:scene_table)
+        names.emplace_back(entry.key);
+    for (const auto &entry:command_table)
+        names.emplace_back(entry.key);
+    for (std::size_t i = 0; names.size() < size; i++)
+        names.push_back((i % 2 ? "outlet-" : "scene-") + std::to_string(i));
+
+    // built at runtime, the names are generated
+    std::map<std::string_view, int, case_insensitive> map;
+    std::array<hash_entry<int>, size> entries;
+    for (std::size_t i = 0; i < size; i++)
+    {
+        map.emplace(names[i], int(i));
+        entries[i] = { names[i], int(i) };
+    }
+    const perfect_hash table{entries};
+    if (!table.valid())
+    {
+        std::printf("no perfect hash for %zu names\n", size);
+        return;
+    }
+
+    std::vector<lookup> lookups;
+    for (const auto &name:names)
+        add_spellings(lookups, table_t::route, name);
+    shuffle(lookups);
+
+    std::printf("name lookup, %zu names in the table, %zu names, 1/4 not matching:\n", size, lookups.size());
+    const auto tree = measure("std::map, case_insensitive", [&](std::size_t i) {
+        const auto it = map.find(lookups[i % lookups.size()].name);
+        keep(it != map.end() ? it->second : -1);
+    });
+    const auto hash = measure("perfect_hash", [&](std::size_t i) {
+        const auto value = table.find(lookups[i % lookups.size()].name);
+        keep(value ? *value : -1);
+    });
+    std::printf("  speedup %.1fx\n", tree / hash);
+}
+
+int main()
+{
+    configured_tables();
+    large_table();
+    return 0;
+}
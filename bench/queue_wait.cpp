@@ -0,0 +1,72 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Check for bench/check.sh: the latencies behind the hedge delay do not
+// include the time a transaction waits for a slot of the scheduler.
+// Status requests are queued behind slots held for a while, then run
+// against the fake PDU. Exits with 1, if the hedge delay includes the wait.
+
+#define main power_switch_main
+#include "../power-switch.cpp"
+#undef main
+
+#include <cstdio>
+
+int main()
+{
+    constexpr auto     hold     = std::chrono::milliseconds(500);
+    constexpr unsigned requests = 30;
+
+    boost::asio::io_context io_context;
+    auto &upstream = boost::asio::use_service<upstream_client>(io_context);
+
+    unsigned completed = 0;
+    unsigned failed    = 0;
+    boost::asio::steady_timer timer{upstream.executor()};
+    boost::asio::dispatch(upstream.executor(), [&]() {
+        // take all slots, so that the status requests have to wait
+        for (int i = 0; i < UPSTREAM_MAX_IN_FLIGHT; i++)
+            upstream.schedule(upstream_priority::high, [](boost::system::error_code) {});
+
+        for (unsigned i = 0; i < requests; i++)
+            async_http_transaction(io_context, status_request(), [&](auto ec, const auto &) {
+                completed++;
+                failed += bool(ec);
+            });
+
+        timer.expires_after(hold);
+        timer.async_wait([&](auto) {
+            for (int i = 0; i < UPSTREAM_MAX_IN_FLIGHT; i++)
+                upstream.done();
+        });
+    });
+
+    while (completed < requests && io_context.run_one())
+        ;
+
+    const auto delay = upstream.hedge_delay();
+    if (failed || !delay)
+    {
+        std::fprintf(stderr, "%u of %u status requests failed\n", failed, requests);
+        return 1;
+    }
+
+    const std::chrono::duration<double, std::milli> ms = *delay;
+    std::printf("        hedge delay %.1f ms, after waiting %lld ms for a slot\n", ms.count(), (long long)hold.count());
+    return *delay < hold ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Building a request to the PDU: the former per-request builder (formatted
+// target, base64 encoded credentials, serialized by Beast) against a lookup
+// in the prebuilt request_table.
+
+#define main power_switch_main
+#include "../power-switch.cpp"
+#undef main
+
+#include "bench.h"
+
+// request building as it was before request_table
+static std::string built_request(channel_mask channels, op_t op)
+{
+    std::ostringstream target;
+    target << "/control_outlet.htm?";
+    for (const auto ch:channels)
+        target << "outlet" << int(ch) << "=1&";
+    target << "op=" << int(op);
+
+    http::request<http::string_body> request{http::verb::get, target.str(), 11};
+    request.set(http::field::host, addr);
+    request.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+    request.set(http::field::authorization, "Basic "s + base64_encode(user + ":" + password));
+
+    std::ostringstream os;
+    os << request;
+    return os.str();
+}
+
+int main()
+{
+    std::printf("request line, switch request for a channel mask:\n");
+    const auto built = measure("ostringstream + base64 + serialize", [](std::size_t i) {
+        keep(built_request(channel_mask::from_bits(std::uint8_t(i)), op_t(i & 1)));
+    });
+    const auto prebuilt = measure("request_table", [](std::size_t i) {
+        const auto request = swith_request(channel_mask::from_bits(std::uint8_t(i)), op_t(i & 1));
+        keep(request.request_line.size() + request.header.size());
+    });
+    std::printf("  speedup %.0fx\n", built / prebuilt);
+    return 0;
+}
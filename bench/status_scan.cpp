@@ -0,0 +1,70 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Parsing status.xml: the full rapidxml parse, that is now only the fallback,
+// against the status_scanner on the fast path. The scanner runs while the
+// response is read (see status_body), so it is measured on its own here.
+
+#define main power_switch_main
+#include "../power-switch.cpp"
+#undef main
+
+#include "bench.h"
+
+// a status.xml as sent by the PDU, with some of its other fields, read
+// like a response from the PDU
+static http::response<status_body> status_document()
+{
+    std::string body = "<?xml version=\"1.0\"?>\n<response>\n";
+    for (int ch = 0; ch < 8; ch++)
+        body += "<outletStat" + std::to_string(ch) + ">" + (ch % 3 ? "on" : "off") + "</outletStat" + std::to_string(ch) + ">\n";
+    body += "<curBan>0.4</curBan>\n<tempBan>24</tempBan>\n<humBan>35</humBan>\n<statBan>Normal</statBan>\n</response>\n";
+
+    http::response<status_body> response{http::status::ok, 11};
+    status_body::reader reader{response, response.body()};
+    boost::system::error_code ec;
+    reader.init(body.size(), ec);
+    reader.put(boost::asio::buffer(body), ec);
+    reader.finish(ec);
+    return response;
+}
+
+int main()
+{
+    const auto response = status_document();
+    const auto expected = parse_status_document(response);
+    const auto scanned = parse_status_response(response);
+    if (scanned.reported_mask != expected.reported_mask || scanned.on_mask != expected.on_mask)
+    {
+        std::fprintf(stderr, "status_scanner and rapidxml disagree\n");
+        return 1;
+    }
+
+    const std::string_view text{response.body().text};
+    std::printf("status scan, %zu byte status.xml:\n", text.size());
+    const auto parsed = measure("rapidxml", [&](std::size_t) {
+        keep(parse_status_document(response).on_mask);
+    });
+    const auto scan = measure("status_scanner", [&](std::size_t) {
+        status_scanner scanner;
+        scanner.feed(text);
+        keep(scanner.on());
+    });
+    std::printf("  speedup %.1fx\n", parsed / scan);
+    return 0;
+}
@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+# Minimal /ws client for bench/check.sh: sends one command and prints the
+# answer to it ("ok <id>" or "error <id> ..."), skipping state messages.
+# usage: ws_command.py <port> <command> <id>
+
+import base64
+import os
+import socket
+import struct
+import sys
+
+port, command, id = int(sys.argv[1]), sys.argv[2], sys.argv[3]
+
+s = socket.create_connection(('127.0.0.1', port))
+key = base64.b64encode(os.urandom(16)).decode()
+s.sendall(('GET /ws HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n'
+           'Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n' % key).encode())
+f = s.makefile('rb')
+while f.readline() not in (b'\r\n', b''):
+    pass
+
+# a masked text frame, as sent by clients
+data = ('%s %s' % (command, id)).encode()
+mask = os.urandom(4)
+header = bytes([0x81]) + (bytes([0x80 | len(data)]) if len(data) < 126 else bytes([0x80 | 126]) + struct.pack('>H', len(data)))
+s.sendall(header + mask + bytes(b ^ mask[i % 4] for i, b in enumerate(data)))
+
+while True:
+    opcode, length = f.read(2)
+    length &= 0x7f
+    if length == 126:
+        length, = struct.unpack('>H', f.read(2))
+    elif length == 127:
+        length, = struct.unpack('>Q', f.read(8))
+    message = f.read(length).decode()
+    if (opcode & 0x0f) == 1 and message.split(' ')[:2] in (['ok', id], ['error', id]):
+        print(message)
+        break
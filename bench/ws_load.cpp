@@ -0,0 +1,211 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// WebSocket load generator for bench/load.sh: opens a number of /ws command
+// channels, each keeping <depth> switch commands in flight for a while, and
+// prints the command rate and latency percentiles.
+// usage: ws_load <host> <port> <connections> <depth> <seconds> [<threads>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+
+static std::atomic<bool> stopped{false};
+
+class connection: public std::enable_shared_from_this<connection>
+{
+public:
+    connection(boost::asio::io_context &io_context, const boost::asio::ip::tcp::resolver::results_type &endpoints, const std::string &host, unsigned depth, unsigned n):
+        ws{boost::asio::make_strand(io_context)},
+        endpoints{endpoints},
+        host{host},
+        depth{depth},
+        next_id{std::uint64_t(n) << 32}
+    {
+    }
+
+    void start()
+    {
+        boost::beast::get_lowest_layer(ws).async_connect(endpoints, [This = shared_from_this()](auto ec, const auto &) {
+            if (ec)
+                return This->failed();
+            This->ws.async_handshake(This->host, "/ws", [This](auto ec) {
+                if (ec)
+                    return This->failed();
+                This->ws.text(true);
+                for (unsigned i = 0; i < This->depth; i++)
+                    This->command();
+                This->read();
+            });
+        });
+    }
+
+    std::vector<double> latencies;  // in microseconds
+    std::uint64_t       errors = 0;
+    std::uint64_t       states = 0;
+
+private:
+    // switch a channel, alternating on and off
+    void command()
+    {
+        if (stopped)
+            return;
+        const auto id = next_id++;
+        sent[id] = std::chrono::steady_clock::now();
+        write("ch" + std::to_string(id % 8 + 1) + (id / 8 % 2 ? " off " : " on ") + std::to_string(id));
+    }
+
+    void write(std::string message)
+    {
+        outgoing.push_back(std::move(message));
+        if (outgoing.size() == 1)
+            write_next();
+    }
+
+    void write_next()
+    {
+        ws.async_write(boost::asio::buffer(outgoing.front()), [This = shared_from_this()](auto ec, auto) {
+            if (ec)
+                return This->failed();
+            This->outgoing.pop_front();
+            if (!This->outgoing.empty())
+                This->write_next();
+        });
+    }
+
+    void read()
+    {
+        ws.async_read(buffer, [This = shared_from_this()](auto ec, auto) {
+            if (ec)
+                return This->failed();
+            const auto message = boost::beast::buffers_to_string(This->buffer.data());
+            This->buffer.consume(This->buffer.size());
+            This->received(message);
+            This->read();
+        });
+    }
+
+    // "ok <id>", "error <id> <reason>" or "state ..."
+    void received(const std::string &message)
+    {
+        if (message.rfind("state", 0) == 0)
+        {
+            states++;
+            return;
+        }
+
+        const bool ok = message.rfind("ok ", 0) == 0;
+        if (!ok)
+            errors++;
+        const auto it = sent.find(std::strtoull(message.c_str() + message.find(' ') + 1, nullptr, 10));
+        if (it == sent.end())
+            return;
+        if (ok)
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - it->second).count());
+        sent.erase(it);
+        command();
+    }
+
+    void failed()
+    {
+        if (!stopped)
+            errors++;
+    }
+
+    boost::beast::websocket::stream<boost::beast::tcp_stream>                  ws;
+    boost::asio::ip::tcp::resolver::results_type                               endpoints;
+    std::string                                                                host;
+    unsigned                                                                   depth;
+    std::uint64_t                                                              next_id;
+    std::unordered_map<std::uint64_t, std::chrono::steady_clock::time_point>   sent;
+    std::deque<std::string>                                                    outgoing;
+    boost::beast::flat_buffer                                                  buffer;
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 6)
+    {
+        std::fprintf(stderr, "usage: %s <host> <port> <connections> <depth> <seconds> [<threads>]\n", argv[0]);
+        return 1;
+    }
+    const std::string host = argv[1];
+    const std::string port = argv[2];
+    const int connections  = std::atoi(argv[3]);
+    const int depth        = std::atoi(argv[4]);
+    const int seconds      = std::atoi(argv[5]);
+    const int threads      = argc > 6 ? std::atoi(argv[6]) : 1;
+
+    boost::asio::io_context io_context;
+    const auto endpoints = boost::asio::ip::tcp::resolver{io_context}.resolve(host, port);
+
+    std::vector<std::shared_ptr<connection>> clients;
+    for (int i = 0; i < connections; i++)
+    {
+        clients.push_back(std::make_shared<connection>(io_context, endpoints, host, unsigned(depth), unsigned(i)));
+        clients.back()->start();
+    }
+
+    boost::asio::steady_timer timer{io_context, std::chrono::seconds(seconds)};
+    timer.async_wait([&](auto) {
+        stopped = true;
+        io_context.stop();
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; i++)
+        pool.emplace_back([&io_context]() { io_context.run(); });
+    io_context.run();
+    for (auto &thread:pool)
+        thread.join();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> latencies;
+    std::uint64_t errors = 0, states = 0;
+    for (const auto &client:clients)
+    {
+        latencies.insert(latencies.end(), client->latencies.begin(), client->latencies.end());
+        errors += client->errors;
+        states += client->states;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, std::size_t(p * latencies.size()))];
+    };
+
+    std::printf("%10.0f cmd/s  p50 %8.0f us  p99 %8.0f us  errors %llu  state messages %llu\n",
+        latencies.size() / elapsed, percentile(0.5), percentile(0.99),
+        static_cast<unsigned long long>(errors), static_cast<unsigned long long>(states));
+    return 0;
+}
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <cctype>
 #include <string>
+#include <string_view>
 
 namespace
 {
@@ -35,6 +36,22 @@ bool iequals(std::string_view lhs, std::string_view rhs)
                       });
 }
 
+// case-insensitive compare of ASCII strings, usable at compile time
+constexpr char ascii_tolower(char ch)
+{
+    return ch >= 'A' && ch <= 'Z' ? char(ch - 'A' + 'a') : ch;
+}
+
+constexpr bool ascii_iequals(std::string_view lhs, std::string_view rhs)
+{
+    if (lhs.size() != rhs.size())
+        return false;
+    for (std::size_t i = 0; i < lhs.size(); i++)
+        if (ascii_tolower(lhs[i]) != ascii_tolower(rhs[i]))
+            return false;
+    return true;
+}
+
 // case insensitive string compare for std::map
 struct case_insensitive
 {
@@ -18,8 +18,21 @@
 
 // NOTE: copy this template file to config.h and change the copy.
 
-#include <map>
+// Updating a config.h of an older version: the channel and scene names are
+// constexpr tables now, the entries stay the same, only the declarations change.
+//     static const std::map<std::string_view, channel, case_insensitive> map_channel_name_to_index{
+// becomes
+//     static constexpr std::pair<std::string_view, channel> channel_names[] {
+// and
+//     static const std::map<std::string_view, scene, case_insensitive> scenes {
+// becomes
+//     static constexpr auto scenes = std::to_array<std::pair<std::string_view, scene>>({
+// closed by "});". Settings missing in an older config.h get their defaults.
+
+#include <array>
+#include <chrono>
 #include <string>
+#include <utility>
 #include "pdu_types.h"
 #include "case_insensitive.h"
 
@@ -31,8 +44,90 @@ const std::string password{"<password>"};
 #define PROXY_BIND_PORT 8192
 #define PROXY_BIND_ADDR "::1"
 
+// keep-alive connections of proxy clients: time a connection may be idle
+// and max. number of requests on a connection, before it is closed
+#define PROXY_IDLE_TIMEOUT std::chrono::seconds(15)
+#define PROXY_MAX_REQUESTS_PER_CONNECTION 100
+
+// command channel (/ws): max. number of commands per connection, that are
+// executed or waiting for their answer to be sent, before reading more
+#define PROXY_WS_MAX_IN_FLIGHT 64
+
+// admission control of proxy clients, can be changed at runtime via /limits:
+// max. number of connections, in total and per client address
+#define PROXY_MAX_SESSIONS 256
+#define PROXY_MAX_SESSIONS_PER_CLIENT 16
+// requests per client address and class: { requests per second, burst },
+// a rate of 0 is unlimited. Requests beyond the rate are answered with 429.
+//   read:  /, /show, /events, /metrics, ...
+//   write: switching channels and scenes
+//   cycle: power cycles, also those sent via /ws
+//   ws:    other commands sent via /ws, answered with "too many requests"
+#define PROXY_RATE_READ { 20, 40 }
+#define PROXY_RATE_WRITE { 5, 10 }
+#define PROXY_RATE_CYCLE { 0.2, 2 }
+#define PROXY_RATE_WS { 5000, 10000 }
+
+// keep-alive connections to the PDU: max. number of idle connections
+// kept open and time after which an idle connection is no longer used
+#define UPSTREAM_MAX_IDLE_CONNECTIONS 2
+#define UPSTREAM_IDLE_TIMEOUT std::chrono::seconds(5)
+
+// time, the resolved PDU address is cached
+#define UPSTREAM_DNS_TTL std::chrono::seconds(300)
+
+// max. age of the switch states served by the proxy, older ones are read
+// from the PDU first. Switching via the proxy updates the states,
+// use /show?fresh=1 to read them from the PDU anyway.
+#define STATUS_CACHE_TIME std::chrono::seconds(5)
+
+// the proxy polls the switch states in the background:
+//   { fast interval, idle interval, fast period }
+// Polling is fast for <fast period> after switching and while web pages or
+// command channels are connected. Otherwise, the interval doubles up to the
+// idle interval, which should be below STATUS_CACHE_TIME.
+#define STATUS_POLL { std::chrono::milliseconds(500), std::chrono::seconds(4), std::chrono::seconds(5) }
+
+// switch commands arriving within this time are reconciled together and
+// take at most one "off" and one "on" request. A channel is not switched,
+// if the switch states polled after the proxy switched it last show it in
+// the requested state already.
+#define SWITCH_BATCH_WINDOW std::chrono::milliseconds(5)
+
+// web page updates (/events): idle streams get a heartbeat
+#define EVENTS_HEARTBEAT std::chrono::seconds(15)
+
+// timeouts of requests to the PDU:
+//   { total, resolve, connect, write, read }
+#define STATUS_REQUEST_TIMEOUTS { std::chrono::seconds(5), std::chrono::seconds(2), std::chrono::seconds(2), std::chrono::seconds(1), std::chrono::seconds(3) }
+#define SWITCH_REQUEST_TIMEOUTS { std::chrono::seconds(10), std::chrono::seconds(2), std::chrono::seconds(3), std::chrono::seconds(2), std::chrono::seconds(5) }
+
+// retrying failed requests to the PDU:
+//   { max. attempts, first backoff, max. backoff, hedging }
+// hedging sends a second request, if the first one is slower than 95% of the recent ones.
+// Switch requests are not retried unless attempts is set > 1 here.
+#define STATUS_REQUEST_RETRY { 3, std::chrono::milliseconds(100), std::chrono::seconds(1), true }
+#define SWITCH_REQUEST_RETRY { 1, std::chrono::milliseconds(100), std::chrono::seconds(1), false }
+
+// circuit breaker: stop sending requests to an unreachable PDU
+//   { window, min. samples, failure rate in %, open time }
+// opens, when the given percentage of the last <window> transactions failed.
+// While open, the proxy answers 503 and lets a single probe pass after <open time>.
+#define CIRCUIT_BREAKER { 20, 5, 50, std::chrono::seconds(10) }
+
+// max. number of concurrent requests to the PDU and of requests waiting for
+// their turn. Switching goes before status requests, "all off" goes first.
+// If the queue is full, the proxy answers 503.
+#define UPSTREAM_MAX_IN_FLIGHT 2
+#define UPSTREAM_MAX_QUEUE 32
+
+// max. number of requests sent on a connection before waiting for their
+// responses, when switching a sequence (e.g. a scene). 1 disables pipelining.
+#define UPSTREAM_PIPELINE_DEPTH 4
+
 // define channel names
-static const std::map<std::string_view, channel, case_insensitive> map_channel_name_to_index{
+// Names are case-insensitive and must not be one of show, metrics, events, ws, api, limits, all or set.
+static constexpr std::pair<std::string_view, channel> channel_names[] {
     {"ch1", ch1},
     {"ch2", ch2},
     {"ch3", ch3},
@@ -49,7 +144,10 @@ static const std::map<std::string_view, channel, case_insensitive> map_channel_n
 };
 
 // define scene names
-static const std::map<std::string_view, scene, case_insensitive> scenes {
+// A scene must not turn a channel both off and on, this is checked at compile time.
+// Without any scenes, declare an empty array instead:
+//     static constexpr std::array<std::pair<std::string_view, scene>, 0> scenes{};
+static constexpr auto scenes = std::to_array<std::pair<std::string_view, scene>>({
     {"scene0", { /*off*/{ch1, ch2}, /*on*/{} }},
     {"scene1", { /*off*/{ch2},      /*on*/{ch1} }},
     {"scene2", { /*off*/{ch1},      /*on*/{ch2} }},
@@ -63,5 +161,5 @@ static const std::map<std::string_view, scene, case_insensitive> scenes {
 //    {"mangenta", { /*off*/{     ch2     },  /*on*/{ch1,      ch3}} }},
 //    {"yellow",   { /*off*/{          ch3},  /*on*/{ch1, ch2     } }},
 //    {"white",    { /*off*/{             },  /*on*/{ch1, ch2, ch3} }},
-};
+});
 
@@ -0,0 +1,67 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <cstdint>
+#include <initializer_list>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// histogram with fixed bucket bounds, written in Prometheus text format
+class histogram
+{
+    std::vector<double>        bounds;
+    std::vector<std::uint64_t> counts;  // one more than bounds, for +Inf
+    double                     sum   = 0;
+    std::uint64_t              count = 0;
+
+public:
+    histogram(std::initializer_list<double> bounds):
+        bounds{bounds},
+        counts(bounds.size() + 1)
+    {
+    }
+
+    void observe(double value)
+    {
+        std::size_t i = 0;
+        while (i < bounds.size() && value > bounds[i])
+            i++;
+        counts[i]++;
+        sum += value;
+        count++;
+    }
+
+    void write(std::ostream &os, std::string_view name) const
+    {
+        std::uint64_t cumulative = 0;
+        for (std::size_t i = 0; i < bounds.size(); i++)
+        {
+            cumulative += counts[i];
+            os << name << "_bucket{le=\"" << bounds[i] << "\"} " << cumulative << "\n";
+        }
+        os << name << "_bucket{le=\"+Inf\"} " << count << "\n";
+        os << name << "_sum " << sum << "\n";
+        os << name << "_count " << count << "\n";
+    }
+};
+
+#endif /* HISTOGRAM_H_ */
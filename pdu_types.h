@@ -19,16 +19,80 @@
 #ifndef PDU_TYPES_H_
 #define PDU_TYPES_H_
 
-#include <set>
+#include <bit>
+#include <cstdint>
+#include <initializer_list>
 
 enum channel { ch1=0, ch2, ch3, ch4, ch5, ch6, ch7, ch8};
 
 enum op_t { on=0, off=1};
 
+// set of channels, one bit per channel
+class channel_mask
+{
+    std::uint8_t bits = 0;
+
+public:
+    constexpr channel_mask() = default;
+
+    constexpr channel_mask(std::initializer_list<channel> channels)
+    {
+        for (auto ch:channels)
+            insert(ch);
+    }
+
+    static constexpr channel_mask from_bits(std::uint8_t bits)
+    {
+        channel_mask ret;
+        ret.bits = bits;
+        return ret;
+    }
+
+    constexpr std::uint8_t to_bits() const { return bits; }
+
+    constexpr bool     empty()                const { return bits == 0; }
+    constexpr unsigned size()                 const { return unsigned(std::popcount(bits)); }
+    constexpr bool     contains(channel ch)   const { return bits & (1 << ch); }
+
+    constexpr void insert(channel ch) { bits |= std::uint8_t(1 << ch); }
+    constexpr void erase(channel ch)  { bits &= std::uint8_t(~(1 << ch)); }
+
+    constexpr channel_mask &operator|=(channel_mask other) { bits |= other.bits; return *this; }
+    constexpr channel_mask &operator&=(channel_mask other) { bits &= other.bits; return *this; }
+    constexpr channel_mask &operator-=(channel_mask other) { bits &= std::uint8_t(~other.bits); return *this; }
+
+    friend constexpr channel_mask operator|(channel_mask lhs, channel_mask rhs) { return lhs |= rhs; }
+    friend constexpr channel_mask operator&(channel_mask lhs, channel_mask rhs) { return lhs &= rhs; }
+    friend constexpr channel_mask operator-(channel_mask lhs, channel_mask rhs) { return lhs -= rhs; }
+    friend constexpr bool operator==(channel_mask lhs, channel_mask rhs) = default;
+
+    // iterates the channels in ascending order
+    class const_iterator
+    {
+        std::uint8_t bits;
+
+    public:
+        constexpr explicit const_iterator(std::uint8_t bits): bits{bits} {}
+
+        constexpr channel operator*() const { return channel(std::countr_zero(bits)); }
+
+        constexpr const_iterator &operator++()
+        {
+            bits &= std::uint8_t(bits - 1);
+            return *this;
+        }
+
+        constexpr bool operator==(const const_iterator &other) const = default;
+    };
+
+    constexpr const_iterator begin() const { return const_iterator{bits}; }
+    constexpr const_iterator end()   const { return const_iterator{0}; }
+};
+
 struct scene
 {
-    std::set<channel> off;
-    std::set<channel> on;
+    channel_mask off;
+    channel_mask on;
 };
 
 #endif /* PDU_TYPES_H_ */
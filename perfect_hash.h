@@ -0,0 +1,115 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERFECT_HASH_H_
+#define PERFECT_HASH_H_
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include "case_insensitive.h"
+
+template<typename T>
+struct hash_entry
+{
+    std::string_view key;
+    T                value{};
+};
+
+// Case-insensitive lookup table for a fixed set of ASCII keys.
+// The table is built at compile time: a seed is searched, for which the hash
+// of every key lands in a slot of its own. A lookup hashes the key once and
+// compares it with the single candidate, no allocation, no tree walk.
+// Duplicate keys (ignoring case) make the table invalid, check valid().
+template<typename T, std::size_t N>
+class perfect_hash
+{
+    static_assert(N < 255);
+    static constexpr std::size_t  table_size = std::bit_ceil(2 * N + 1);
+    static constexpr std::uint8_t empty      = 0xff;
+
+    std::array<hash_entry<T>, N>           entries;
+    std::array<std::uint8_t, table_size>   slots{};
+    std::uint32_t                          seed  = 0;
+    bool                                   ok    = false;
+
+    static constexpr std::size_t slot(std::string_view key, std::uint32_t seed)
+    {
+        // FNV-1a over the lower case key
+        std::uint32_t h = 2166136261u ^ seed;
+        for (const char ch:key)
+        {
+            h ^= std::uint8_t(ascii_tolower(ch));
+            h *= 16777619u;
+        }
+        return (h ^ (h >> 15)) & (table_size - 1);
+    }
+
+    constexpr bool place(std::uint32_t seed)
+    {
+        slots.fill(empty);
+        for (std::size_t i = 0; i < N; i++)
+        {
+            auto &s = slots[slot(entries[i].key, seed)];
+            if (s != empty)
+                return false;
+            s = std::uint8_t(i);
+        }
+        return true;
+    }
+
+public:
+    constexpr explicit perfect_hash(const std::array<hash_entry<T>, N> &entries):
+        entries{entries}
+    {
+        for (std::size_t i = 0; i < N; i++)
+            for (std::size_t j = 0; j < i; j++)
+                if (ascii_iequals(entries[i].key, entries[j].key))
+                    return;
+
+        for (std::uint32_t s = 0; s < 0x10000; s++)
+        {
+            if (place(s))
+            {
+                seed = s;
+                ok   = true;
+                return;
+            }
+        }
+    }
+
+    // all keys are unique and a seed has been found
+    constexpr bool valid() const { return ok; }
+
+    constexpr const T *find(std::string_view key) const
+    {
+        const auto i = slots[slot(key, seed)];
+        if (i == empty || !ascii_iequals(entries[i].key, key))
+            return nullptr;
+        return &entries[i].value;
+    }
+
+    constexpr auto begin() const { return entries.begin(); }
+    constexpr auto end()   const { return entries.end(); }
+};
+
+template<typename T, std::size_t N>
+perfect_hash(const std::array<hash_entry<T>, N>&) -> perfect_hash<T, N>;
+
+#endif /* PERFECT_HASH_H_ */
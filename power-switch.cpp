@@ -19,35 +19,140 @@
 #include "config.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <iomanip>
 #include <iostream>
 #include <list>
-#include <map>
-#include <set>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
 #include <sstream>
 #include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <boost/archive/iterators/base64_from_binary.hpp>
 #include <boost/archive/iterators/transform_width.hpp>
 #include <boost/archive/iterators/ostream_iterator.hpp>
+#include <boost/asio/bind_executor.hpp>
 #include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/dispatch.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/ip/v6_only.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/recycling_allocator.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/json/src.hpp>
 #include <boost/system/error_code.hpp>
 
 #include "case_insensitive.h"
+#include "histogram.h"
 #include "http_status_error_category.h"
+#include "perfect_hash.h"
 #include "rapidxml.hpp"
+#include "shared_string_body.h"
+#include "status_body.h"
+#include "status_scanner.h"
+#include "upstream_error.h"
 
 #ifdef _WIN32
 #include "WindowsService.h"
 #endif
 
+// defaults for settings not present in config.h
+#ifndef UPSTREAM_MAX_IDLE_CONNECTIONS
+#define UPSTREAM_MAX_IDLE_CONNECTIONS 2
+#endif
+#ifndef UPSTREAM_IDLE_TIMEOUT
+#define UPSTREAM_IDLE_TIMEOUT std::chrono::seconds(5)
+#endif
+#ifndef UPSTREAM_DNS_TTL
+#define UPSTREAM_DNS_TTL std::chrono::seconds(300)
+#endif
+#ifndef STATUS_CACHE_TIME
+#define STATUS_CACHE_TIME std::chrono::seconds(5)
+#endif
+#ifndef SWITCH_BATCH_WINDOW
+#define SWITCH_BATCH_WINDOW std::chrono::milliseconds(5)
+#endif
+#ifndef STATUS_POLL
+#define STATUS_POLL { std::chrono::milliseconds(500), std::chrono::seconds(4), std::chrono::seconds(5) }
+#endif
+#ifndef EVENTS_HEARTBEAT
+#define EVENTS_HEARTBEAT std::chrono::seconds(15)
+#endif
+#ifndef STATUS_REQUEST_TIMEOUTS
+#define STATUS_REQUEST_TIMEOUTS { std::chrono::seconds(5), std::chrono::seconds(2), std::chrono::seconds(2), std::chrono::seconds(1), std::chrono::seconds(3) }
+#endif
+#ifndef SWITCH_REQUEST_TIMEOUTS
+#define SWITCH_REQUEST_TIMEOUTS { std::chrono::seconds(10), std::chrono::seconds(2), std::chrono::seconds(3), std::chrono::seconds(2), std::chrono::seconds(5) }
+#endif
+#ifndef STATUS_REQUEST_RETRY
+#define STATUS_REQUEST_RETRY { 3, std::chrono::milliseconds(100), std::chrono::seconds(1), true }
+#endif
+#ifndef SWITCH_REQUEST_RETRY
+#define SWITCH_REQUEST_RETRY { 1, std::chrono::milliseconds(100), std::chrono::seconds(1), false }
+#endif
+#ifndef CIRCUIT_BREAKER
+#define CIRCUIT_BREAKER { 20, 5, 50, std::chrono::seconds(10) }
+#endif
+#ifndef UPSTREAM_MAX_IN_FLIGHT
+#define UPSTREAM_MAX_IN_FLIGHT 2
+#endif
+#ifndef UPSTREAM_MAX_QUEUE
+#define UPSTREAM_MAX_QUEUE 32
+#endif
+#ifndef UPSTREAM_PIPELINE_DEPTH
+#define UPSTREAM_PIPELINE_DEPTH 4
+#endif
+#ifndef PROXY_IDLE_TIMEOUT
+#define PROXY_IDLE_TIMEOUT std::chrono::seconds(15)
+#endif
+#ifndef PROXY_MAX_REQUESTS_PER_CONNECTION
+#define PROXY_MAX_REQUESTS_PER_CONNECTION 100
+#endif
+#ifndef PROXY_WS_MAX_IN_FLIGHT
+#define PROXY_WS_MAX_IN_FLIGHT 64
+#endif
+#ifndef PROXY_MAX_SESSIONS
+#define PROXY_MAX_SESSIONS 256
+#endif
+#ifndef PROXY_MAX_SESSIONS_PER_CLIENT
+#define PROXY_MAX_SESSIONS_PER_CLIENT 16
+#endif
+#ifndef PROXY_RATE_READ
+#define PROXY_RATE_READ { 20, 40 }
+#endif
+#ifndef PROXY_RATE_WRITE
+#define PROXY_RATE_WRITE { 5, 10 }
+#endif
+#ifndef PROXY_RATE_CYCLE
+#define PROXY_RATE_CYCLE { 0.2, 2 }
+#endif
+#ifndef PROXY_RATE_WS
+#define PROXY_RATE_WS { 5000, 10000 }
+#endif
+
 static const char *license_info =
 "Copyright (C) 2025 Mario Klebsch, DG1AM\n"
 "License GPLv3+: GNU GPL version 3 or later <https://gnu.org/licenses/gpl.html>.\n"
@@ -56,19 +161,87 @@ static const char *license_info =
 
 
 // return a sef of all channels
-static auto all_channels()
+static constexpr channel_mask all_channels()
 {
-    std::set<channel> ret;
-    for (const auto &item:map_channel_name_to_index)
+    channel_mask ret;
+    for (const auto &item:channel_names)
         ret.insert(item.second);
     return ret;
 }
 
+// name of each channel, empty for channels without a name
+static constexpr auto name_of_channel = []() {
+    std::array<std::string_view, 8> names;
+    for (const auto &[name, ch]:channel_names)
+        names[ch] = name;
+    return names;
+}();
+
+// channel lookup by name, case-insensitive
+static constexpr auto channel_table = []() {
+    std::array<hash_entry<channel>, std::size(channel_names)> entries;
+    for (std::size_t i = 0; i < entries.size(); i++)
+        entries[i] = { channel_names[i].first, channel_names[i].second };
+    return perfect_hash{entries};
+}();
+static_assert(channel_table.valid(), "duplicate channel name in config.h");
+
+// scenes must not turn a channel both off and on
+static constexpr bool valid_scenes()
+{
+    for (const auto &item:scenes)
+        if (!(item.second.off & item.second.on).empty())
+            return false;
+    return true;
+}
+static_assert(valid_scenes(), "invalid scene in config.h: channel both off and on");
+
+// scene lookup by name, case-insensitive
+static constexpr auto scene_table = []() {
+    std::array<hash_entry<const scene*>, std::size(scenes)> entries;
+    for (std::size_t i = 0; i < entries.size(); i++)
+        entries[i] = { scenes[i].first, &scenes[i].second };
+    return perfect_hash{entries};
+}();
+static_assert(scene_table.valid(), "duplicate scene name in config.h");
+
+static const scene *find_scene(std::string_view name)
+{
+    const auto scene = scene_table.find(name);
+    return scene ? *scene : nullptr;
+}
+
+// FNV-1a over the channel and scene configuration. Entity tags include it,
+// so that pages cached by clients are invalidated by a new configuration.
+static constexpr std::uint32_t config_version = []() {
+    std::uint32_t h = 2166136261u;
+    const auto add = [&h](std::uint8_t byte) {
+        h ^= byte;
+        h *= 16777619u;
+    };
+    for (const auto &[name, ch]:channel_names)
+    {
+        for (const char c:name)
+            add(std::uint8_t(c));
+        add(0);
+        add(std::uint8_t(ch));
+    }
+    for (const auto &[name, scene]:scenes)
+    {
+        for (const char c:name)
+            add(std::uint8_t(c));
+        add(0);
+        add(scene.off.to_bits());
+        add(scene.on.to_bits());
+    }
+    return h;
+}();
+
 
 // Parse a channel list. Example: "153" is parsed to a list of ch1, ch3 and ch5
 // Channel list is added to existing channels
 // returns false on invalid input.
-static bool parse_channel_list(std::string_view list, std::set<channel> &channels)
+static bool parse_channel_list(std::string_view list, channel_mask &channels)
 {
     for (const auto ch:list)
     {
@@ -82,13 +255,12 @@ static bool parse_channel_list(std::string_view list, std::set<channel> &channel
 
 static auto parse_channels(int argc, const char *argv[])
 {
-    std::set<channel> ret;
+    channel_mask ret;
     while (argc--)
     {
         auto arg = *argv++;
-        auto it = map_channel_name_to_index.find(arg);
-        if (it != map_channel_name_to_index.end())
-            ret.insert(it->second);
+        if (const auto ch = channel_table.find(arg))
+            ret.insert(*ch);
         else if (iequals(arg, "all"))
             ret = all_channels();
         else if (!parse_channel_list(arg, ret))
@@ -97,29 +269,12 @@ static auto parse_channels(int argc, const char *argv[])
     return ret;
 }
 
-// invert std::map:
-// Create a new map with data of input as keys
-// and keys of input as data.
-template<typename T1, typename T2, typename Cmp>
-static auto invert_map(const std::map<T1, T2, Cmp>&map)
-{
-    std::map<T2,T1> ret;
-    for (const auto &item:map)
-        ret[item.second] = item.first;
-    return ret;
-}
-
 std::ostream& operator<<(std::ostream &s, channel channel)
 {
-    static const auto map_channel_index_to_name=invert_map(map_channel_name_to_index);
-    
-    auto it = map_channel_index_to_name.find(channel);
-    if (it != map_channel_index_to_name.end())
-        s << it->second;
-    return s;
+    return s << name_of_channel[channel];
 }
 
-std::ostream& operator<<(std::ostream &s, const std::set<channel>&channels)
+std::ostream& operator<<(std::ostream &s, channel_mask channels)
 {
     bool first=true;
     for (const auto ch:channels)
@@ -140,7 +295,7 @@ std::string to_string(const channel channel)
     return os.str();
 }
 
-std::string to_string(const std::set<channel>&channels)
+std::string to_string(channel_mask channels)
 {
     std::ostringstream os;
     os << channels;
@@ -175,561 +330,3463 @@ using namespace std::string_literals;
 namespace http = boost::beast::http;
 
 
-// syncronous http transaction
-http::response<http::string_body>
-http_transaction(http::request<http::string_body> &&request,
-                 http::status                       expected_status,
-                 boost::system::error_code         &ec)
+// time budget of a transaction with the PDU
+struct upstream_timeouts
 {
-    boost::asio::io_context io_context;
+    std::chrono::milliseconds total;    // whole transaction, incl. reconnecting a stale connection
+    std::chrono::milliseconds resolve;
+    std::chrono::milliseconds connect;
+    std::chrono::milliseconds write;
+    std::chrono::milliseconds read;
+};
 
-    const auto resolved=boost::asio::ip::tcp::resolver{io_context}.resolve(addr, port,  ec);
-    if (ec)
-        return {};
+static constexpr upstream_timeouts status_request_timeouts = STATUS_REQUEST_TIMEOUTS;
+static constexpr upstream_timeouts switch_request_timeouts = SWITCH_REQUEST_TIMEOUTS;
+
+// deadline of a transaction, split over its phases
+class upstream_deadline
+{
+    const upstream_timeouts               &timeouts;
+    std::chrono::steady_clock::time_point deadline;
 
-    auto it = resolved.begin();
-    while (it != resolved.end() && ! it->endpoint().address().is_v4())
-        it++;
+    // time left for a phase, limited by the deadline of the whole transaction
+    std::chrono::steady_clock::duration left(std::chrono::milliseconds phase) const
+    {
+        const auto remaining = deadline - std::chrono::steady_clock::now();
+        return std::max(std::chrono::steady_clock::duration::zero(),
+                        std::min<std::chrono::steady_clock::duration>(phase, remaining));
+    }
 
-    //    std::cout << "connecting " << it->endpoint().address().to_string() << "\n";
-    boost::beast::tcp_stream s{io_context};
-    s.connect(*it, ec);
-    if (ec)
-        return {};
+public:
+    explicit upstream_deadline(const upstream_timeouts &timeouts):
+        timeouts{timeouts},
+        deadline{std::chrono::steady_clock::now() + timeouts.total}
+    {
+    }
 
-    namespace http = boost::beast::http;
+    auto resolve() const { return left(timeouts.resolve); }
+    auto connect() const { return left(timeouts.connect); }
+    auto write()   const { return left(timeouts.write); }
+    auto read()    const { return left(timeouts.read); }
 
-    request.set(http::field::host, addr);
-    request.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-    request.set(http::field::authorization, "Basic "s + base64_encode(user + ":" + password) );
-    http::write(s, request, ec);
-    if (ec)
-        return {};
+    auto remaining() const { return left(timeouts.total); }
+};
 
-    boost::beast::flat_buffer buffer;
-    http::response<http::string_body> response;
-    http::read(s, buffer, response, ec);
-    if (ec)
-        return {};
+// retry policy of a request type
+struct upstream_retry_policy
+{
+    unsigned                  attempts;     // max. number of attempts, 1 disables retries
+    std::chrono::milliseconds backoff;      // delay before the first retry, doubled for every further retry
+    std::chrono::milliseconds max_backoff;
+    bool                      hedge;        // start a second attempt, if the first one is slower than usual
+};
 
-    s.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-    ec={};
+static constexpr upstream_retry_policy status_request_retry = STATUS_REQUEST_RETRY;
+static constexpr upstream_retry_policy switch_request_retry = SWITCH_REQUEST_RETRY;
 
-    if (response.result() != expected_status)
+// scheduling priority of a request to the PDU
+enum class upstream_priority { low, normal, high };
+
+// ready to send request to the PDU, refers to the prebuilt request_table
+struct upstream_request
+{
+    std::string_view            request_line;
+    std::string_view            header;     // common header fields, incl. the terminating empty line
+    const upstream_timeouts     &timeouts;
+    const upstream_retry_policy &retry;
+    upstream_priority           priority;
+
+    std::array<boost::asio::const_buffer, 2> buffers() const
+    {
+        return { boost::asio::buffer(request_line), boost::asio::buffer(header) };
+    }
+};
+
+// Prebuilt requests to the PDU.
+// There are 8 channels and 2 operations, so there are only 512 switch
+// requests plus the status request. All of them are serialized once,
+// so sending a request needs neither formatting nor allocation.
+class request_table
+{
+    static constexpr std::size_t status_index = 2 * 256;
+    static constexpr std::size_t header_index = status_index + 1;
+
+    std::string                              data;
+    std::array<std::size_t, header_index+1> offsets;
+
+    request_table()
+    {
+        std::ostringstream os;
+        for (int op = 0; op < 2; op++)
+            for (int mask = 0; mask < 256; mask++)
+            {
+                offsets[op * 256 + mask] = os.tellp();
+                os << "GET /control_outlet.htm?";
+                for (int ch = 0; ch < 8; ch++)
+                    if (mask & (1 << ch))
+                        os << "outlet" << ch << "=1&";
+                os << "op=" << op << " HTTP/1.1\r\n";
+            }
+
+        offsets[status_index] = os.tellp();
+        os << "GET /status.xml HTTP/1.1\r\n";
+
+        offsets[header_index] = os.tellp();
+        os << "Host: " << addr << "\r\n"
+           << "User-Agent: " << BOOST_BEAST_VERSION_STRING << "\r\n"
+           << "Authorization: Basic " << base64_encode(user + ":" + password) << "\r\n"
+           << "\r\n";
+
+        data = os.str();
+    }
+
+    upstream_request get(std::size_t index, const upstream_timeouts &timeouts, const upstream_retry_policy &retry, upstream_priority priority) const
+    {
+        const std::string_view s{data};
+        return { s.substr(offsets[index], offsets[index+1] - offsets[index]), s.substr(offsets[header_index]), timeouts, retry, priority };
+    }
+
+public:
+    static const request_table &instance()
+    {
+        static const request_table table;
+        return table;
+    }
+
+    upstream_request swith(std::uint8_t mask, op_t op) const
+    {
+        return get(op * 256 + mask, switch_request_timeouts, switch_request_retry, upstream_priority::normal);
+    }
+
+    upstream_request status() const
     {
-        ec = make_error_code(response.result());
-        return {};
+        return get(status_index, status_request_timeouts, status_request_retry, upstream_priority::low);
     }
+};
+
+//power switch request
+static inline upstream_request swith_request(channel_mask channels, op_t op)
+{
+    auto request = request_table::instance().swith(channels.to_bits(), op);
 
-    return response;
+    // turning everything off goes first
+    if (op == off && channels == all_channels())
+        request.priority = upstream_priority::high;
+    return request;
 }
 
-inline http::response<http::string_body>
-http_transaction(http::request<http::string_body> &&request, boost::system::error_code &ec)
+// status request
+static inline upstream_request status_request()
 {
-    return http_transaction(std::move(request), http::status::ok, ec);
+    return request_table::instance().status();
 }
 
 
-// asyncronous http transaction
-template<typename CB>
-void async_http_transaction(boost::asio::io_context           &io_context,
-                            http::request<http::string_body> &&request,
-                            http::status                       expected_status,
-                            const CB                          &cb)
+// circuit breaker settings
+struct circuit_breaker_policy
 {
+    unsigned                  window;           // number of recent transactions to consider, max. 64
+    unsigned                  min_samples;      // min. number of transactions, before the breaker may open
+    unsigned                  failure_percent;  // failure rate opening the breaker
+    std::chrono::milliseconds open_time;        // time until a probe is let through
+};
 
-    class http_op: public std::enable_shared_from_this<http_op>
+static constexpr circuit_breaker_policy circuit_breaker_settings = CIRCUIT_BREAKER;
+static_assert(circuit_breaker_settings.window > 0 && circuit_breaker_settings.window <= 64);
+
+// Circuit breaker for the PDU.
+// closed:    transactions pass. The breaker opens, when too many of the recent
+//            transactions failed.
+// open:      transactions are rejected immediately, until open_time has elapsed.
+// half_open: a single probe transaction passes. On success the breaker closes,
+//            on failure it opens again. Late results of transactions admitted
+//            before do not change the state, only the one of the probe does.
+class circuit_breaker
+{
+public:
+    enum class state_t { closed, open, half_open };
+    using ticket = std::uint64_t;   // identifies an admitted transaction
+
+private:
+    // state and open_until may be read by any thread, everything else
+    // is only used on the upstream strand
+    const circuit_breaker_policy          &policy;
+    std::atomic<state_t>                  state   = state_t::closed;
+    std::atomic<std::chrono::steady_clock::time_point> open_until;
+    std::uint64_t                         history = 0;  // one bit per transaction, set on failure
+    unsigned                              samples = 0;
+    bool                                  probing = false;
+    ticket                                probe   = 0;  // admitted in half_open
+    ticket                                tickets = 0;  // last one issued
+
+    void trip()
     {
-        using std::enable_shared_from_this<http_op>::shared_from_this;
-        
-        boost::asio::ip::tcp::resolver    resolver;
-        boost::beast::tcp_stream          s;
-        http::request<http::string_body>  request;
-        CB                                cb;
-        boost::beast::flat_buffer         buffer;
-        http::response<http::string_body> response;
-        http::status                      expected_status;
+        state      = state_t::open;
+        open_until = std::chrono::steady_clock::now() + policy.open_time;
+        opened++;
+    }
 
-        http_op()=delete;
-        http_op(const http_op&)=delete;
-        http_op&operator=(const http_op&)=delete;
+    void reset()
+    {
+        state   = state_t::closed;
+        history = 0;
+        samples = 0;
+    }
 
-    public:
-        http_op(boost::asio::io_context &io_context, http::request<http::string_body> &&request, http::status expected_status, const CB &cb):
-            resolver{io_context},
-            s{io_context},
-            request{std::move(request)},
-            expected_status{expected_status},
-            cb{cb}
-        {
-            this->request.set(http::field::host, addr);
-            this->request.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-            this->request.set(http::field::authorization, "Basic "s + base64_encode(user + ":" + password) );
-        }
+public:
+    std::uint64_t opened   = 0;
+    std::uint64_t rejected = 0;
 
-        void start()
-        {
-            resolver.async_resolve(addr, port, [This=shared_from_this()](auto ec, auto it) {
-                if (ec)
-                {
-                    This->cb(ec, This->response);
-                    return;
-                }
-                const decltype(it) end;
-                while (it != end && ! it->endpoint().address().is_v4())
-                    it++;
+    explicit circuit_breaker(const circuit_breaker_policy &policy):
+        policy{policy}
+    {
+    }
 
-                This->connect(it);
-            });
+    state_t get_state() const
+    {
+        if (state == state_t::open && std::chrono::steady_clock::now() >= open_until.load())
+            return state_t::half_open;
+        return state;
+    }
+
+    const char *state_name() const
+    {
+        return name(get_state());
+    }
+
+    static const char *name(state_t state)
+    {
+        switch (state)
+        {
+            case state_t::closed:    return "closed";
+            case state_t::open:      return "open";
+            case state_t::half_open: return "half-open";
         }
+        return "<unknown>";
+    }
 
-    private:
-        void connect(const boost::asio::ip::tcp::resolver::iterator& it)
+    // time until the next probe is let through
+    std::chrono::seconds retry_after() const
+    {
+        const auto left = std::chrono::ceil<std::chrono::seconds>(open_until.load() - std::chrono::steady_clock::now());
+        return std::max(left, std::chrono::seconds(1));
+    }
+
+    // may a transaction be started? Its ticket is to be passed to record().
+    std::optional<ticket> admit()
+    {
+        if (state == state_t::open && get_state() == state_t::half_open)
         {
-//            std::cout << "connecting " << it->endpoint().address().to_string() << "\n";
-            s.async_connect(*it, [This=shared_from_this()](auto ec) {
-                if (ec)
-                {
-                    This->cb(ec, This->response);
-                    return;
-                }
-                This->send();
-            });
+            state   = state_t::half_open;
+            probing = false;
         }
 
-        void send()
+        if (state == state_t::closed)
+            return ++tickets;
+        if (state == state_t::half_open && !probing)
         {
-            http::async_write(s, request, [This=shared_from_this()](auto ec, auto bytes_written) {
-                if (ec)
-                {
-                    This->cb(ec, This->response);
-                    return;
-                }
-                This->receive();
-            } );
-            
+            probing = true;
+            probe   = ++tickets;
+            return probe;
         }
+        rejected++;
+        return std::nullopt;
+    }
 
-        void receive()
+    // outcome of an admitted transaction
+    void record(ticket t, bool failed)
+    {
+        switch (state)
         {
-            http::async_read(s, buffer, response, [This=shared_from_this()](auto ec, auto bytes_written) {
-                if (ec)
-                    return This->cb(ec, This->response);
+            case state_t::half_open:
+                if (t != probe)
+                    return; // late result of a transaction admitted before the probe
+                return failed ? trip() : reset();
 
-                boost::system::error_code e;
-                This->s.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, e);
-                if (This->response.result() != This->expected_status)
-                    This->cb(make_error_code(This->response.result()), This->response);
+            case state_t::open:
+                return; // late result of a transaction started before opening
 
-                This->cb(boost::system::error_code{}, This->response);
-            });
+            case state_t::closed:
+                break;
         }
-    };
 
-    std::make_shared<http_op>(io_context, std::move(request), expected_status, cb)->start();
-}
-
-template<typename CB>
-inline void async_http_transaction(boost::asio::io_context &io_context, http::request<http::string_body> &&request, const CB &cb)
-{
-    return async_http_transaction(io_context, std::move(request), http::status::ok, cb);
-}
+        const auto mask = policy.window == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << policy.window) - 1;
+        history = (history << 1 | failed) & mask;
+        samples = std::min(samples + 1, policy.window);
+        if (samples >= policy.min_samples && unsigned(std::popcount(history)) * 100 >= policy.failure_percent * samples)
+            trip();
+    }
+};
 
-//power switch request
-static inline http::request<http::string_body> swith_request(const std::set<channel> &channels, op_t op)
+// keep-alive connection to the PDU
+struct upstream_connection
 {
-    std::ostringstream os;
-    os << "/control_outlet.htm?";
-    for (auto ch:channels)
-        os << "outlet" << int(ch) << "=1&";
-    os << "op=" << int(op);
-    return {http::verb::get, os.str(), 11};
-}
+    explicit upstream_connection(const boost::asio::any_io_executor &executor):
+        s{executor}
+    {
+    }
 
-// status request
-static inline http::request<http::string_body> status_request()
-{
-    return {http::verb::get, "/status.xml", 11};
+    boost::beast::tcp_stream              s;
+    boost::beast::flat_buffer             buffer;
+    std::chrono::steady_clock::time_point idle_since;
+    unsigned                              generation = 0; // incremented whenever the connection is taken from the pool
+    bool                                  reused = false; // connection was taken from the pool and may be stale
 };
 
-struct channel_status
+// Pool of keep-alive connections to the PDU.
+// There is one pool per io_context, use boost::asio::use_service<upstream_client>() to get it.
+class upstream_client: public boost::asio::io_context::service
 {
-    channel          channel;
-    std::string_view name;
-    bool             state;
-};
+public:
+    using connection_ptr = std::shared_ptr<upstream_connection>;
+    using connect_cb     = std::function<void(boost::system::error_code, connection_ptr)>;
+    using endpoint_list  = std::vector<boost::asio::ip::tcp::endpoint>;
+    using resolve_cb     = std::function<void(boost::system::error_code, const endpoint_list&)>;
+
+    static inline boost::asio::io_context::id id;
+
+    explicit upstream_client(boost::asio::io_context &io_context):
+        boost::asio::io_context::service{io_context},
+        io_context{io_context},
+        strand{boost::asio::make_strand(io_context)},
+        resolver{strand},
+        refresh_timer{strand}
+    {
+    }
 
-// status response
-static std::list<channel_status> parse_status_response(const http::response<http::string_body> &response)
-{
-    rapidxml::xml_document<> doc;
-    doc.parse<0>(response.body());
+    using executor_type = boost::asio::strand<boost::asio::io_context::executor_type>;
 
-    std::list<channel_status> ret;
-    
-    const auto& root = doc.first_node().value();
-    std::ostringstream os;
+    // The upstream state (connections, scheduler, caches, statistics) is only
+    // accessed on this strand, so that the proxy can run on a thread pool.
+    const executor_type &executor() const { return strand; }
 
-    for (int ch = 0; ch < 8; ch++)
+    // upstream statistics, reported by the proxy's /metrics
+    struct statistics
     {
-        auto n = root.first_node("outletStat"s + char('0' + ch));
-        if (!n.has_value())
-            continue;
+        std::uint64_t dns_hits      = 0;
+        std::uint64_t dns_misses    = 0;
+        std::uint64_t dns_refreshes = 0;
+        std::uint64_t dns_failures  = 0;
+        std::uint64_t dns_fallbacks = 0;
+        std::uint64_t retries       = 0;
+        std::uint64_t hedges        = 0;
+        std::uint64_t hedge_wins    = 0;
+        std::uint64_t failures      = 0;
+        std::uint64_t overloaded    = 0;
+    };
 
-        static const auto map_channel_index_to_name = invert_map(map_channel_name_to_index);
+    statistics &stats() { return stat; }
 
-        auto it = map_channel_index_to_name.find(channel(ch));
-        if (it == map_channel_index_to_name.end())
-            continue;
-        ret.emplace_back(channel(ch), it->second, iequals(n.value().value(), "on"));
+    circuit_breaker &breaker() { return circuit; }
+
+    using slot_cb = std::function<void(boost::system::error_code)>;
+
+    // Start a transaction, if less than UPSTREAM_MAX_IN_FLIGHT are running.
+    // Otherwise it waits in the queue of its priority class. When the queue is
+    // full, a waiting transaction of lower priority is rejected, or this one.
+    void schedule(upstream_priority priority, slot_cb cb)
+    {
+        queue_depth.observe(queued);
+        if (in_flight < UPSTREAM_MAX_IN_FLIGHT && queued == 0)
+        {
+            in_flight++;
+            queue_wait.observe(0);
+            return cb({});
+        }
+
+        if (queued >= UPSTREAM_MAX_QUEUE)
+        {
+            auto victim = std::find_if(queues.begin(), queues.begin() + int(priority),
+                                       [](const auto &q) { return !q.empty(); });
+            if (victim == queues.begin() + int(priority))
+                return reject(std::move(cb));
+
+            reject(std::move(victim->back().cb));
+            victim->pop_back();
+            queued--;
+        }
+
+        queues[int(priority)].push_back({std::move(cb), std::chrono::steady_clock::now()});
+        queued++;
     }
-    return ret;
-}
 
-template<typename S>
-static S strip_path_element(S &path)
-{
-    static constexpr char delimiter='/';
-    std::size_t n;
-    while ((n = path.find(delimiter))==0)
-        path = path.substr(1);
-    
-    S ret;
-    if (n == std::string::npos)
+    // an additional slot for a hedged request, only if one is free right now
+    bool try_schedule()
     {
-        ret = path;
-        path={};
+        if (in_flight >= UPSTREAM_MAX_IN_FLIGHT || queued)
+            return false;
+        in_flight++;
+        return true;
     }
-    else
+
+    // a transaction has finished, start the oldest one of the highest priority
+    void done()
     {
-        ret = path.substr(0, n);
-        path = path.substr(n+1);
-        while ((n = path.find(delimiter))==0)
-            path = path.substr(1);
+        in_flight--;
+        for (auto q = queues.rbegin(); q != queues.rend(); q++)
+        {
+            if (q->empty())
+                continue;
+            auto waiter = std::move(q->front());
+            q->pop_front();
+            queued--;
+            in_flight++;
+            queue_wait.observe(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waiter.since).count());
+            boost::asio::post(strand, [cb = std::move(waiter.cb)]() { cb({}); });
+            return;
+        }
     }
-    return ret;
-}
 
-#ifdef PROXY_BIND_PORT
-namespace http = boost::beast::http;
-using namespace std::string_literals;
-using tcp = boost::asio::ip::tcp;
-class proxy_server
-{
+    void write_metrics(std::ostream &os) const
+    {
+        os << "upstream_dns_hits "      << stat.dns_hits      << "\n";
+        os << "upstream_dns_misses "    << stat.dns_misses    << "\n";
+        os << "upstream_dns_refreshes " << stat.dns_refreshes << "\n";
+        os << "upstream_dns_failures "  << stat.dns_failures  << "\n";
+        os << "upstream_dns_fallbacks " << stat.dns_fallbacks << "\n";
+        os << "upstream_retries "       << stat.retries       << "\n";
+        os << "upstream_hedges "        << stat.hedges        << "\n";
+        os << "upstream_hedge_wins "    << stat.hedge_wins    << "\n";
+        os << "upstream_failures "      << stat.failures      << "\n";
+        os << "# upstream_circuit_state: 0 closed, 1 open, 2 half-open\n";
+        os << "upstream_circuit_state "    << int(circuit.get_state()) << "\n";
+        os << "upstream_circuit_opened "   << circuit.opened   << "\n";
+        os << "upstream_circuit_rejected " << circuit.rejected << "\n";
+        os << "upstream_in_flight "     << in_flight     << "\n";
+        os << "upstream_queued "        << queued        << "\n";
+        os << "upstream_overloaded "    << stat.overloaded << "\n";
+        queue_depth.write(os, "upstream_queue_depth");
+        queue_wait.write(os, "upstream_queue_wait_ms");
+    }
 
-    class session : public std::enable_shared_from_this<session>
+    // delay before retry n (1, 2, ...): exponential backoff with jitter
+    std::chrono::milliseconds backoff(const upstream_retry_policy &retry, unsigned n)
     {
-        boost::asio::io_context& io_context;
-        boost::beast::tcp_stream         s;
-        boost::beast::flat_buffer        buffer;
-        http::request<http::string_body> request;
-        boost::asio::deadline_timer      timer;
+        const auto delay = std::min<std::chrono::milliseconds>(retry.max_backoff, retry.backoff * (1u << std::min(n - 1, 16u)));
+        std::uniform_int_distribution<std::chrono::milliseconds::rep> jitter{delay.count() / 2, delay.count()};
+        return std::chrono::milliseconds{jitter(random)};
+    }
 
-    public:
-        explicit session(boost::asio::io_context& io_context, tcp::socket&& s) :
-            io_context{ io_context },
-            s{ std::move(s) },
-            timer{ io_context }
+    // latency of a successful transaction with hedging enabled
+    void record_latency(std::chrono::steady_clock::duration latency)
+    {
+        latencies[latency_count++ % latencies.size()] = latency;
+    }
+
+    // delay after which a hedged request is sent: the 95th percentile of
+    // recent latencies, nothing if there are not enough samples yet
+    std::optional<std::chrono::steady_clock::duration> hedge_delay() const
+    {
+        const auto n = std::min(latency_count, latencies.size());
+        if (n < 20)
+            return {};
+        auto sorted = latencies;
+        const auto p95 = sorted.begin() + n * 95 / 100;
+        std::nth_element(sorted.begin(), p95, sorted.begin() + n);
+        return *p95;
+    }
+
+    // Resolve the PDU address. The (IPv4) endpoints are cached for UPSTREAM_DNS_TTL
+    // and refreshed in the background while in use. If resolving fails, the last
+    // good endpoints are used. cb may be called before resolve() returns.
+    void resolve(resolve_cb cb)
+    {
+        dns_used = true;
+        if (!endpoints.empty() && std::chrono::steady_clock::now() < endpoints_expiry)
         {
+            stat.dns_hits++;
+            return cb({}, endpoints);
+        }
+
+        stat.dns_misses++;
+        resolve_waiters.push_back(std::move(cb));
+        refresh();
+    }
+
+    // get an idle connection from the pool or open a new one
+    void acquire(connect_cb cb, const upstream_deadline &deadline)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        while (!idle.empty())
+        {
+            auto c = std::move(idle.back());
+            idle.pop_back();
+            take(*c);
+            if (now - c->idle_since < UPSTREAM_IDLE_TIMEOUT)
+            {
+                c->reused = true;
+                boost::asio::post(strand, [cb = std::move(cb), c = std::move(c)]() { cb({}, c); });
+                return;
+            }
+            boost::system::error_code e;
+            c->s.socket().close(e);
+        }
+        connect(std::move(cb), deadline);
+    }
+
+    // open a new connection, bypassing the pool
+    void connect(connect_cb cb, const upstream_deadline &deadline)
+    {
+        // resolver has no timeout, so race it against a timer. Whichever
+        // completes first, takes cb.
+        auto pending = std::make_shared<connect_cb>(std::move(cb));
+        auto timer   = std::make_shared<boost::asio::steady_timer>(strand, deadline.resolve());
+        timer->async_wait([pending](auto ec) {
+            if (!ec && *pending)
+                std::exchange(*pending, nullptr)(upstream_error::timeout, nullptr);
+        });
+
+        resolve([this, pending, timer, connect_timeout = deadline.connect()](auto ec, const auto &endpoints) {
+            timer->cancel();
+            if (!*pending)
+                return;
+            auto cb = std::exchange(*pending, nullptr);
+            if (ec)
+                return cb(ec, nullptr);
+
+            auto c = std::make_shared<upstream_connection>(strand);
+            c->s.expires_after(connect_timeout);
+            c->s.async_connect(endpoints, [c, cb](auto ec, const auto &endpoint) {
+                if (ec == boost::beast::error::timeout)
+                    return cb(upstream_error::timeout, nullptr);
+                if (ec)
+                    return cb(ec, nullptr);
+                cb({}, c);
+            });
+        });
+    }
+
+    // return a connection to the pool after a complete transaction
+    void release(connection_ptr c)
+    {
+        boost::system::error_code e;
+        if (UPSTREAM_MAX_IDLE_CONNECTIONS == 0)
+        {
+            c->s.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, e);
+            c->s.socket().close(e);
+            return;
+        }
+
+        // drop the oldest connection if the pool is full
+        if (idle.size() >= UPSTREAM_MAX_IDLE_CONNECTIONS)
+        {
+            take(*idle.front());
+            idle.front()->s.socket().close(e);
+            idle.erase(idle.begin());
+        }
+
+        c->s.expires_never();
+        c->idle_since = std::chrono::steady_clock::now();
+        idle.push_back(c);
+        watch(std::move(c));
+    }
+
+    // open a connection in advance, so that the first request does not pay for TCP setup
+    void prewarm()
+    {
+        connect([this](auto ec, auto c) {
+            if (ec)
+            {
+                std::cerr << "prewarming upstream connection failed: " << ec.message() << "\n";
+                return;
+            }
+            release(std::move(c));
+        }, upstream_deadline{status_request_timeouts});
+    }
+
+private:
+    void shutdown() override
+    {
+        boost::system::error_code e;
+        for (auto &c:idle)
+            c->s.socket().close(e);
+        idle.clear();
+        resolver.cancel();
+        refresh_timer.cancel();
+        resolve_waiters.clear();
+        for (auto &q:queues)
+            q.clear();
+    }
+
+    void reject(slot_cb cb)
+    {
+        stat.overloaded++;
+        boost::asio::post(strand, [cb = std::move(cb)]() { cb(upstream_error::overloaded); });
+    }
+
+    // (re-)resolve the PDU address
+    void refresh()
+    {
+        if (resolving)
+            return;
+        resolving = true;
+        dns_used  = false;
+        stat.dns_refreshes++;
+
+        resolver.async_resolve(addr, port, [this](auto ec, const auto &results) {
+            resolving = false;
+            if (ec == boost::asio::error::operation_aborted)
+                return;
+
+            endpoint_list resolved;
+            for (const auto &entry:results)
+                if (entry.endpoint().address().is_v4())
+                    resolved.push_back(entry.endpoint());
+            if (!ec && resolved.empty())
+                ec = boost::asio::error::host_not_found;
+
+            const auto now = std::chrono::steady_clock::now();
+            if (ec)
+            {
+                stat.dns_failures++;
+                if (!endpoints.empty())
+                {
+                    std::cerr << "resolve(" << addr << ") failed: " << ec.message() << ", using cached address\n";
+                    stat.dns_fallbacks += resolve_waiters.size();
+                    // keep the last good endpoints for a while, before trying again
+                    endpoints_expiry = now + UPSTREAM_DNS_TTL / 4;
+                    ec = {};
+                }
+            }
+            else
+            {
+                endpoints = std::move(resolved);
+                endpoints_expiry = now + UPSTREAM_DNS_TTL;
+
+                // refresh before expiry, if the endpoints are still in use by then
+                if (UPSTREAM_DNS_TTL > decltype(UPSTREAM_DNS_TTL)::zero())
+                {
+                    refresh_timer.expires_after(UPSTREAM_DNS_TTL * 3 / 4);
+                    refresh_timer.async_wait([this](auto ec) {
+                        if (!ec && dns_used)
+                            refresh();
+                    });
+                }
+            }
+
+            auto waiters = std::move(resolve_waiters);
+            resolve_waiters.clear();
+            for (const auto &cb:waiters)
+                cb(ec, endpoints);
+        });
+    }
+
+    // mark connection as being no longer idle
+    static void take(upstream_connection &c)
+    {
+        boost::system::error_code e;
+        c.generation++;
+        c.s.socket().cancel(e);
+    }
+
+    // An idle keep-alive connection should never become readable. If it does,
+    // the PDU has closed it (or sent garbage), so drop it from the pool.
+    void watch(connection_ptr c)
+    {
+        c->s.socket().async_wait(boost::asio::ip::tcp::socket::wait_read,
+            [this, c, generation = c->generation](auto ec) {
+                if (c->generation != generation)
+                    return; // connection has been taken from the pool meanwhile
+
+                std::erase(idle, c);
+                boost::system::error_code e;
+                c->s.socket().close(e);
+            });
+    }
+
+    boost::asio::io_context               &io_context;
+    executor_type                         strand;
+    std::vector<connection_ptr>           idle;
+
+    boost::asio::ip::tcp::resolver        resolver;
+    boost::asio::steady_timer             refresh_timer;
+    endpoint_list                         endpoints;
+    std::chrono::steady_clock::time_point endpoints_expiry;
+    std::vector<resolve_cb>               resolve_waiters;
+    bool                                  resolving = false;
+    bool                                  dns_used  = false;
+
+    std::array<std::chrono::steady_clock::duration, 64> latencies{};
+    std::size_t                           latency_count = 0;
+    std::minstd_rand                      random{std::random_device{}()};
+
+    circuit_breaker                       circuit{circuit_breaker_settings};
+
+    struct waiter
+    {
+        slot_cb                               cb;
+        std::chrono::steady_clock::time_point since;
+    };
+    std::array<std::deque<waiter>, 3>     queues;   // indexed by upstream_priority
+    unsigned                              in_flight = 0;
+    unsigned                              queued    = 0;
+    histogram                             queue_depth{1, 2, 4, 8, 16, 32, 64};
+    histogram                             queue_wait{1, 5, 10, 50, 100, 500, 1000, 5000};
+
+    statistics                            stat;
+};
+
+
+// Network errors, timeouts and server errors indicate a problem with the PDU,
+// they may go away when trying again.
+static bool upstream_failure(const boost::system::error_code &ec)
+{
+    if (ec.category() == http::error_category())
+        return ec.value() >= 500;
+    return bool(ec);
+}
+
+// One attempt of a transaction: send a sequence of requests to the PDU and
+// receive the responses. Up to UPSTREAM_PIPELINE_DEPTH requests are written
+// at once (HTTP/1.1 pipelining), before waiting for their responses.
+class upstream_exchange: public std::enable_shared_from_this<upstream_exchange>
+{
+public:
+    using response_type = http::response<status_body>;
+
+    // receives the outcome of the exchange, i.e. the transaction it is an attempt of
+    class owner
+    {
+    public:
+        virtual void completed(unsigned attempt, const upstream_exchange *x, const boost::system::error_code &ec, std::vector<response_type> &responses) = 0;
+
+    protected:
+        ~owner() = default;
+    };
+
+private:
+    // two buffers per request, see upstream_request::buffers()
+    using buffer_list = std::array<boost::asio::const_buffer, 2 * UPSTREAM_PIPELINE_DEPTH>;
+
+    upstream_client                      &upstream;
+    upstream_client::connection_ptr      c;
+    const std::vector<upstream_request>  &requests;
+    std::vector<response_type>           responses;
+    http::status                         expected_status;
+    upstream_deadline                    deadline;
+    std::shared_ptr<owner>               op;
+    unsigned                             attempt   = 0;
+    std::size_t                          sent      = 0;     // requests written to the connection
+    std::size_t                          answered  = 0;     // responses received
+    std::size_t                          progress  = 0;     // responses received on the current connection
+    bool                                 cancelled = false;
+    buffer_list                          buffers;           // of the requests being written
+
+public:
+    // requests are owned by the transaction and must outlive the exchange
+    upstream_exchange(upstream_client &upstream, const std::vector<upstream_request> &requests, http::status expected_status, const upstream_deadline &deadline):
+        upstream{upstream},
+        requests{requests},
+        responses(requests.size()),
+        expected_status{expected_status},
+        deadline{deadline}
+    {
+    }
+    upstream_exchange()=delete;
+    upstream_exchange(const upstream_exchange&)=delete;
+    upstream_exchange&operator=(const upstream_exchange&)=delete;
+
+    void start(std::shared_ptr<owner> op, unsigned attempt)
+    {
+        this->op      = std::move(op);
+        this->attempt = attempt;
+        upstream.acquire([This=shared_from_this()](auto ec, auto c) {
+            This->connected(ec, std::move(c));
+        }, deadline);
+    }
+
+    // abandon the exchange, the result is no longer needed
+    void cancel()
+    {
+        cancelled = true;
+        if (c)
+        {
+            boost::system::error_code e;
+            c->s.socket().close(e);
+        }
+    }
+
+private:
+    void done(const boost::system::error_code &ec)
+    {
+        std::exchange(op, nullptr)->completed(attempt, this, ec, responses);
+    }
+
+    void connected(const boost::system::error_code &ec, upstream_client::connection_ptr c)
+    {
+        if (ec)
+            return done(ec);
+        if (cancelled)
+            return upstream.release(std::move(c));
+        this->c  = std::move(c);
+        sent     = answered;
+        progress = 0;
+        send();
+    }
+
+    void send()
+    {
+        const auto n = std::min(requests.size() - sent, std::size_t(UPSTREAM_PIPELINE_DEPTH));
+        std::size_t count = 0;
+        for (std::size_t i = sent; i < sent + n; i++)
+            for (const auto &b:requests[i].buffers())
+                buffers[count++] = b;
+        sent += n;
+
+        c->s.expires_after(deadline.write());
+        boost::asio::async_write(c->s, std::span{ buffers.data(), count }, [This=shared_from_this()](auto ec, auto bytes_written) {
+            if (ec)
+                return This->failed(ec);
+            This->receive();
+        } );
+        
+    }
+
+    void receive()
+    {
+        c->s.expires_after(deadline.read());
+        responses[answered] = {};
+        http::async_read(c->s, c->buffer, responses[answered], [This=shared_from_this()](auto ec, auto bytes_written) {
+            if (ec)
+                return This->failed(ec);
+            This->received();
+        });
+    }
+
+    void received()
+    {
+        const auto &response = responses[answered++];
+        progress++;
+        const bool keep_alive = response.keep_alive();
+
+        if (response.result() != expected_status)
+        {
+            // the responses to the remaining pipelined requests are not read, so the connection is unusable
+            if (keep_alive && answered == sent)
+                upstream.release(std::move(c));
+            else
+                close();
+            return done(make_error_code(response.result()));
+        }
+
+        if (answered == requests.size())
+        {
+            if (keep_alive)
+                upstream.release(std::move(c));
+            else
+                close();
+            return done({});
+        }
+
+        if (!keep_alive)
+        {
+            // the PDU does not answer further requests on this connection
+            close();
+            return reconnect();
+        }
+
+        if (answered < sent)
+            receive();
+        else
+            send();
+    }
+
+    void close()
+    {
+        boost::system::error_code e;
+        c->s.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, e);
+        c->s.socket().close(e);
+        c.reset();
+    }
+
+    void reconnect()
+    {
+        upstream.connect([This=shared_from_this()](auto ec, auto c) {
+            This->connected(ec, std::move(c));
+        }, deadline);
+    }
+
+    // A connection from the pool may have been closed by the PDU in the meantime,
+    // or the PDU closed the connection after answering some of the pipelined requests.
+    // In that case, transparently repeat the unanswered requests on a fresh connection.
+    // A timeout is not repeated, the PDU is just not answering.
+    void failed(const boost::system::error_code &ec)
+    {
+        const bool stale = c->reused || progress > 0;
+        boost::system::error_code e;
+        c->s.socket().close(e);
+        c.reset();
+
+        if (ec == boost::beast::error::timeout)
+            return done(upstream_error::timeout);
+        if (!stale || cancelled)
+            return done(ec);
+
+        reconnect();
+    }
+};
+
+// asyncronous http transaction, a sequence of requests pipelined on one connection
+// The timeouts, retry policy and priority of the first request apply to the whole
+// sequence. cb is called with a response for each request.
+// Failed attempts are retried according to the request's retry policy. If
+// the policy allows hedging, a second attempt is started in parallel when
+// the first one takes longer than 95% of the recent transactions.
+template<typename CB>
+void async_http_pipeline(boost::asio::io_context           &io_context,
+                         std::vector<upstream_request>      requests,
+                         http::status                       expected_status,
+                         const CB                          &cb)
+{
+    using response_list = std::vector<upstream_exchange::response_type>;
+
+    class http_op: public std::enable_shared_from_this<http_op>, public upstream_exchange::owner
+    {
+        using std::enable_shared_from_this<http_op>::shared_from_this;
+        
+        upstream_client                                 &upstream;
+        std::vector<upstream_request>                   requests;
+        upstream_deadline                               deadline;
+        http::status                                    expected_status;
+        CB                                              cb;
+        boost::asio::steady_timer                       timer;          // retry backoff or hedging delay
+        std::vector<std::shared_ptr<upstream_exchange>> running;
+        std::chrono::steady_clock::time_point           started;
+        unsigned                                        attempts = 0;
+        unsigned                                        hedge    = 0;   // attempt started for hedging
+        unsigned                                        slots    = 0;   // taken from the scheduler
+        circuit_breaker::ticket                         ticket   = 0;   // of the breaker, for record()
+        bool                                            done     = false;
+
+        http_op()=delete;
+        http_op(const http_op&)=delete;
+        http_op&operator=(const http_op&)=delete;
+
+        const upstream_retry_policy &retry() const { return requests.front().retry; }
+
+    public:
+        http_op(boost::asio::io_context &io_context, std::vector<upstream_request> &&requests, http::status expected_status, const CB &cb):
+            upstream{boost::asio::use_service<upstream_client>(io_context)},
+            requests{std::move(requests)},
+            deadline{this->requests.front().timeouts},
+            expected_status{expected_status},
+            cb{cb},
+            timer{upstream.executor()}
+        {
+        }
+
+        void start()
+        {
+            // fail fast while the breaker is open, without queueing
+            if (upstream.breaker().get_state() == circuit_breaker::state_t::open)
+            {
+                upstream.breaker().rejected++;
+                boost::asio::post(timer.get_executor(), [This=shared_from_this()]() {
+                    This->rejected(upstream_error::circuit_open);
+                });
+                return;
+            }
+
+            upstream.schedule(requests.front().priority, [This=shared_from_this()](auto ec) {
+                if (ec)
+                    return This->rejected(ec);
+
+                // The breaker is asked only with a slot granted, so that an
+                // admitted probe always runs and its outcome is recorded.
+                const auto ticket = This->upstream.breaker().admit();
+                if (!ticket)
+                {
+                    This->upstream.done();
+                    return This->rejected(upstream_error::circuit_open);
+                }
+                This->ticket = *ticket;
+                This->slots++;
+                This->run();
+            });
+        }
+
+    private:
+        void rejected(const boost::system::error_code &ec)
+        {
+            response_list responses(requests.size());
+            cb(ec, responses);
+        }
+
+        // The latency recorded for the hedge delay starts here, time spent
+        // waiting for a slot of the scheduler is not part of it.
+        void run()
+        {
+            started = std::chrono::steady_clock::now();
+            launch();
+
+            if (!retry().hedge || retry().attempts < 2)
+                return;
+            const auto delay = upstream.hedge_delay();
+            if (!delay)
+                return;
+            timer.expires_after(*delay);
+            timer.async_wait([This=shared_from_this()](auto ec) {
+                if (ec || This->done || !This->upstream.try_schedule())
+                    return;
+                This->slots++;
+                This->upstream.stats().hedges++;
+                This->hedge = This->attempts + 1;
+                This->launch();
+            });
+        }
+
+        void launch()
+        {
+            auto x = std::allocate_shared<upstream_exchange>(boost::asio::recycling_allocator<upstream_exchange>(), upstream, requests, expected_status, deadline);
+            running.push_back(x);
+            x->start(shared_from_this(), ++attempts);
+        }
+
+        void completed(unsigned attempt, const upstream_exchange *x, const boost::system::error_code &ec, response_list &responses) override
+        {
+            std::erase_if(running, [x](const auto &r) { return r.get() == x; });
+            if (done)
+                return;
+
+            if (ec && upstream_failure(ec))
+            {
+                if (!running.empty())
+                    return; // wait for the hedged attempt
+
+                if (attempts < retry().attempts)
+                {
+                    const auto delay = upstream.backoff(retry(), attempts);
+                    if (delay < deadline.remaining())
+                    {
+                        upstream.stats().retries++;
+                        timer.expires_after(delay);
+                        timer.async_wait([This=shared_from_this()](auto ec) {
+                            if (!ec && !This->done)
+                                This->launch();
+                        });
+                        return;
+                    }
+                }
+            }
+            finish(attempt, ec, responses);
+        }
+
+        void finish(unsigned attempt, const boost::system::error_code &ec, response_list &responses)
+        {
+            done = true;
+            timer.cancel();
+            for (const auto &x:running)
+                x->cancel();
+            running.clear();
+
+            for (; slots; slots--)
+                upstream.done();
+            upstream.breaker().record(ticket, upstream_failure(ec));
+            if (ec)
+                upstream.stats().failures++;
+            else
+            {
+                if (attempt == hedge)
+                    upstream.stats().hedge_wins++;
+                if (retry().hedge && requests.size() == 1)
+                    upstream.record_latency(std::chrono::steady_clock::now() - started);
+            }
+            cb(ec, responses);
+        }
+    };
+
+    std::allocate_shared<http_op>(boost::asio::recycling_allocator<http_op>(), io_context, std::move(requests), expected_status, cb)->start();
+}
+
+// asyncronous http transaction
+template<typename CB>
+void async_http_transaction(boost::asio::io_context           &io_context,
+                            upstream_request                   request,
+                            http::status                       expected_status,
+                            const CB                          &cb)
+{
+    async_http_pipeline(io_context, {request}, expected_status, [cb](auto ec, auto &responses) {
+        cb(ec, responses.front());
+    });
+}
+
+template<typename CB>
+inline void async_http_transaction(boost::asio::io_context &io_context, upstream_request request, const CB &cb)
+{
+    return async_http_transaction(io_context, request, http::status::ok, cb);
+}
+
+// one io_context for all synchronous transactions, so that
+// consecutive requests can reuse the keep-alive connection
+static boost::asio::io_context &sync_io_context()
+{
+    static boost::asio::io_context io_context;
+    return io_context;
+}
+
+// syncronous http transaction
+http::response<status_body>
+http_transaction(upstream_request                   request,
+                 http::status                       expected_status,
+                 boost::system::error_code         &ec)
+{
+    auto &io_context = sync_io_context();
+
+    http::response<status_body> ret;
+    bool done = false;
+    async_http_transaction(io_context, request, expected_status, [&](auto e, const auto &response) {
+        ec = e;
+        if (!ec)
+            ret = response;
+        done = true;
+    });
+
+    io_context.restart();
+    while (!done && io_context.run_one())
+        ;
+    return ret;
+}
+
+inline http::response<status_body>
+http_transaction(upstream_request request, boost::system::error_code &ec)
+{
+    return http_transaction(request, http::status::ok, ec);
+}
+
+// syncronous http transaction, a sequence of requests pipelined on one connection
+void http_pipeline(std::vector<upstream_request> requests, boost::system::error_code &ec)
+{
+    auto &io_context = sync_io_context();
+
+    bool done = false;
+    async_http_pipeline(io_context, std::move(requests), http::status::ok, [&](auto e, const auto &responses) {
+        ec = e;
+        done = true;
+    });
+
+    io_context.restart();
+    while (!done && io_context.run_one())
+        ;
+}
+
+struct channel_status
+{
+    channel          channel;
+    std::string_view name;
+    bool             state;
+};
+
+// switch states reported by the PDU, one bit per channel
+// Iterating yields the reported channels, that have a name.
+struct channel_states
+{
+    channel_mask reported_mask;
+    channel_mask on_mask;
+
+    class const_iterator
+    {
+        const channel_states *states;
+        int                  ch;
+
+        void skip()
+        {
+            while (ch < 8 && (!states->reported_mask.contains(channel(ch)) || name_of_channel[ch].empty()))
+                ch++;
+        }
+
+    public:
+        const_iterator(const channel_states *states, int ch):
+            states{states},
+            ch{ch}
+        {
+            skip();
+        }
+
+        channel_status operator*() const
+        {
+            return { channel(ch), name_of_channel[ch], states->on_mask.contains(channel(ch)) };
+        }
+
+        const_iterator &operator++()
+        {
+            ch++;
+            skip();
+            return *this;
+        }
+
+        bool operator==(const const_iterator &other) const { return ch == other.ch; }
+    };
+
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end()   const { return {this, 8}; }
+
+    bool operator==(const channel_states &) const = default;
+
+    // channels have been switched
+    void set(channel_mask channels, op_t op)
+    {
+        if (op == on)
+            on_mask |= channels & reported_mask;
+        else
+            on_mask -= channels;
+    }
+};
+
+// Full XML parse of status.xml, for documents the status_scanner does not understand.
+static channel_states parse_status_document(const http::response<status_body> &response)
+{
+    rapidxml::xml_document<> doc;
+    doc.parse<0>(response.body().text);
+
+    channel_states ret;
+    const auto& root = doc.first_node().value();
+    char name[] = "outletStat0";
+    for (int ch = 0; ch < 8; ch++)
+    {
+        name[sizeof(name) - 2] = char('0' + ch);
+        auto n = root.first_node(name);
+        if (!n.has_value())
+            continue;
+        ret.reported_mask.insert(channel(ch));
+        if (iequals(n.value().value(), "on"))
+            ret.on_mask.insert(channel(ch));
+    }
+    return ret;
+}
+
+// status response, scanned while it was read, see status_body
+static channel_states parse_status_response(const http::response<status_body> &response)
+{
+    const auto &scanner = response.body().scanner;
+    if (!scanner.complete())
+        return parse_status_document(response);
+    return { channel_mask::from_bits(scanner.reported()), channel_mask::from_bits(scanner.on()) };
+}
+
+// background polling of the switch states by the proxy
+struct status_poll_policy
+{
+    std::chrono::milliseconds fast;         // interval after switching and while clients are subscribed
+    std::chrono::milliseconds idle;         // max. interval, when nothing happens
+    std::chrono::milliseconds fast_period;  // time, polling stays fast after switching
+};
+
+static constexpr status_poll_policy status_poll_settings = STATUS_POLL;
+static_assert(status_poll_settings.fast.count() > 0 && status_poll_settings.fast <= status_poll_settings.idle);
+
+// The switch states as known to the proxy, kept current by a background poller.
+// Reads are served from this model, if it is not older than STATUS_CACHE_TIME.
+// Otherwise, or if fresh states are requested, they wait for a status request
+// started right away. Concurrent reads and polls share a single request, a
+// read joins a request in flight only, if no channels were switched via the
+// proxy since it was sent. Otherwise it waits for the next one.
+// The poller runs at the fast interval after switching and while clients are
+// subscribed to changes. When nothing happens, the interval doubles up to the
+// idle interval. While the circuit breaker is open, polling pauses.
+// Switching channels through the proxy updates the model or invalidates it,
+// if the outcome is unknown. Without start(), states are fetched on demand only.
+class status_fetcher: public boost::asio::io_context::service
+{
+public:
+    using status_cb        = std::function<void(boost::system::error_code, const channel_states&)>;
+    using state_listener   = std::function<void(const channel_states&)>;
+    using breaker_listener = std::function<void(circuit_breaker::state_t)>;
+
+    static inline boost::asio::io_context::id id;
+
+    explicit status_fetcher(boost::asio::io_context &io_context):
+        boost::asio::io_context::service{io_context},
+        io_context{io_context},
+        poll_timer{boost::asio::use_service<upstream_client>(io_context).executor()}
+    {
+    }
+
+    // start polling in the background
+    void start()
+    {
+        if (started)
+            return;
+        started = true;
+        poll();
+    }
+
+    // get switch states, from the model unless fresh is set
+    void fetch(status_cb cb, bool fresh = false)
+    {
+        if (!fresh && observed())
+        {
+            cache_hits++;
+            return cb({}, cache);
+        }
+
+        if (in_flight)
+        {
+            // a request sent before switching may return the states from before
+            if (request_generation != generation)
+                return next_waiters.push_back(std::move(cb));
+            coalesced++;
+            return waiters.push_back(std::move(cb));
+        }
+        waiters.push_back(std::move(cb));
+        request_status();
+    }
+
+    // switch states of the model, if they are not older than STATUS_CACHE_TIME
+    std::optional<channel_states> observed() const
+    {
+        if (!cache_valid || std::chrono::steady_clock::now() - cache_time >= STATUS_CACHE_TIME)
+            return std::nullopt;
+        return cache;
+    }
+
+    // time the model was last read from the PDU, if it is not older than
+    // STATUS_CACHE_TIME. Switching via the proxy does not change this time.
+    std::optional<std::chrono::steady_clock::time_point> observed_at() const
+    {
+        if (!observed())
+            return std::nullopt;
+        return cache_time;
+    }
+
+    // channels have been switched successfully
+    void update(channel_mask channels, op_t op)
+    {
+        generation++;
+        cache.set(channels, op);
+        if (published)
+        {
+            auto switch_states = *published;
+            switch_states.set(channels, op);
+            publish(switch_states);
+        }
+        speed_up();
+    }
+
+    // channels may have been switched
+    void invalidate()
+    {
+        generation++;
+        cache_valid = false;
+        speed_up();
+        if (started)
+            schedule(std::chrono::milliseconds(0));
+    }
+
+    // Call listener with the switch states now and whenever they change, and
+    // breaker with the state of the circuit breaker, as seen by the poller.
+    void subscribe(const void *key, state_listener listener, breaker_listener breaker = nullptr)
+    {
+        if (published)
+            listener(*published);
+        if (breaker)
+            breaker(boost::asio::use_service<upstream_client>(io_context).breaker().get_state());
+        listeners[key] = { std::move(listener), std::move(breaker) };
+        interval = status_poll_settings.fast;
+        if (started)
+            schedule(interval);
+    }
+
+    void unsubscribe(const void *key)
+    {
+        listeners.erase(key);
+    }
+
+    void write_metrics(std::ostream &os) const
+    {
+        os << "status_fetches "          << fetches    << "\n";
+        os << "status_coalesced "        << coalesced  << "\n";
+        os << "status_cache_hits "       << cache_hits << "\n";
+        os << "status_polls "            << polls      << "\n";
+        os << "status_polls_paused "     << paused     << "\n";
+        os << "status_poll_interval_ms " << interval.count() << "\n";
+        os << "status_listeners "        << listeners.size() << "\n";
+        os << "status_events "           << events     << "\n";
+    }
+
+private:
+    void shutdown() override
+    {
+        waiters.clear();
+        next_waiters.clear();
+        listeners.clear();
+        poll_timer.cancel();
+    }
+
+    // poll at the fast interval for a while
+    void speed_up()
+    {
+        fast_until = std::chrono::steady_clock::now() + status_poll_settings.fast_period;
+        interval   = status_poll_settings.fast;
+        if (started)
+            schedule(interval);
+    }
+
+    // poll after delay, unless a poll is due earlier anyway
+    void schedule(std::chrono::steady_clock::duration delay)
+    {
+        // the next poll is scheduled, when the status request completes
+        if (in_flight)
+            return;
+
+        const auto at = std::chrono::steady_clock::now() + delay;
+        if (waiting && poll_timer.expiry() <= at)
+            return;
+
+        waiting = true;
+        poll_timer.expires_at(at);
+        poll_timer.async_wait([this](auto ec) {
+            if (ec)
+                return;
+            waiting = false;
+            poll();
+        });
+    }
+
+    void poll()
+    {
+        if (in_flight)
+            return;
+
+        const auto &breaker = boost::asio::use_service<upstream_client>(io_context).breaker();
+        if (breaker.get_state() == circuit_breaker::state_t::open)
+        {
+            paused++;
+            publish_breaker();
+            return schedule(breaker.retry_after());
+        }
+
+        polls++;
+        request_status();
+    }
+
+    // fast after switching and while clients are subscribed, backing off otherwise
+    std::chrono::milliseconds next_interval()
+    {
+        if (!listeners.empty() || std::chrono::steady_clock::now() < fast_until)
+            interval = status_poll_settings.fast;
+        else
+            interval = std::min(interval * 2, status_poll_settings.idle);
+        return interval;
+    }
+
+    void request_status()
+    {
+        in_flight          = true;
+        request_generation = generation;
+        fetches++;
+        async_http_transaction(io_context, status_request(), [this, generation = generation](auto ec, const auto &response) {
+            in_flight = false;
+
+            channel_states switch_states;
+            if (!ec)
+            {
+                try
+                {
+                    switch_states = parse_status_response(response);
+                }
+                catch (const std::exception& ex)
+                {
+                    std::cerr << "xml parsing failed: " << ex.what() << "\n";
+                    ec = upstream_error::invalid_status_document;
+                }
+            }
+
+            // do not update the model, if channels were switched while fetching
+            if (!ec && generation == this->generation)
+            {
+                cache       = switch_states;
+                cache_time  = std::chrono::steady_clock::now();
+                cache_valid = true;
+                publish(switch_states);
+            }
+
+            publish_breaker();
+
+            auto callbacks = std::move(waiters);
+            waiters.clear();
+            if (!next_waiters.empty())
+            {
+                waiters = std::move(next_waiters);
+                next_waiters.clear();
+                request_status();
+            }
+            for (const auto &cb:callbacks)
+                cb(ec, switch_states);
+
+            if (started)
+                schedule(next_interval());
+        });
+    }
+
+    // tell the listeners about changed switch states
+    void publish(const channel_states &switch_states)
+    {
+        if (published == switch_states)
+            return;
+        published = switch_states;
+
+        events++;
+        auto current = listeners;
+        for (const auto &[key, listener]:current)
+            listener.states(switch_states);
+    }
+
+    // tell the listeners about a changed state of the circuit breaker
+    void publish_breaker()
+    {
+        const auto state = boost::asio::use_service<upstream_client>(io_context).breaker().get_state();
+        if (published_breaker == state)
+            return;
+        published_breaker = state;
+
+        auto current = listeners;
+        for (const auto &[key, listener]:current)
+            if (listener.breaker)
+                listener.breaker(state);
+    }
+
+    boost::asio::io_context               &io_context;
+    std::vector<status_cb>                waiters;        // for the request in flight
+    std::vector<status_cb>                next_waiters;   // for a request sent after switching
+    bool                                  in_flight = false;
+    unsigned                              request_generation = 0; // of the request in flight
+
+    channel_states                        cache;
+    std::chrono::steady_clock::time_point cache_time;
+    bool                                  cache_valid = false;
+    unsigned                              generation  = 0;
+
+    struct listener
+    {
+        state_listener   states;
+        breaker_listener breaker;
+    };
+    std::unordered_map<const void*, listener> listeners;
+    std::optional<channel_states>         published;   // last states told to the listeners
+    std::optional<circuit_breaker::state_t> published_breaker;
+
+    boost::asio::steady_timer             poll_timer;
+    bool                                  started  = false;
+    bool                                  waiting  = false;  // for poll_timer
+    std::chrono::milliseconds             interval = status_poll_settings.fast;
+    std::chrono::steady_clock::time_point fast_until;
+
+    std::uint64_t                         fetches    = 0;
+    std::uint64_t                         coalesced  = 0;
+    std::uint64_t                         cache_hits = 0;
+    std::uint64_t                         polls      = 0;
+    std::uint64_t                         paused     = 0;
+    std::uint64_t                         events     = 0;
+};
+
+// Call cb with args on its associated executor (e.g. the strand of a proxy session).
+// Without an associated executor, cb is called directly.
+template<typename CB, typename... Args>
+static void complete(const CB &cb, const Args&... args)
+{
+    boost::asio::dispatch(boost::asio::get_associated_executor(cb), [cb, args...]() { cb(args...); });
+}
+
+// asyncronous status request, cb is called with the parsed switch states
+template<typename CB>
+inline void async_status_transaction(boost::asio::io_context &io_context, bool fresh, const CB &cb)
+{
+    boost::asio::dispatch(boost::asio::use_service<upstream_client>(io_context).executor(), [&io_context, fresh, cb]() {
+        boost::asio::use_service<status_fetcher>(io_context).fetch([cb](auto ec, const auto &switch_states) {
+            complete(cb, ec, switch_states);
+        }, fresh);
+    });
+}
+
+// Switch channels by reconciling a desired state with the observed one.
+// Commands only change the desired state of their channels. After
+// SWITCH_BATCH_WINDOW, all pending commands are reconciled at once: channels
+// the status model shows in their desired state are not switched, if the
+// model has been read from the PDU after the proxy switched them last. The
+// rest takes at most one "off" and one "on" request, pipelined on one
+// connection. A burst of commands for a channel collapses into its last one.
+// There is one reconciliation at a time, commands arriving meanwhile wait for
+// the next one.
+class switch_reconciler: public boost::asio::io_context::service
+{
+public:
+    using switch_cb = std::function<void(boost::system::error_code)>;
+
+    struct step
+    {
+        channel_mask channels;
+        op_t         op;
+    };
+
+    static inline boost::asio::io_context::id id;
+
+    explicit switch_reconciler(boost::asio::io_context &io_context):
+        boost::asio::io_context::service{io_context},
+        io_context{io_context},
+        timer{boost::asio::use_service<upstream_client>(io_context).executor()}
+    {
+    }
+
+    // Switch a sequence of steps, later steps and commands take precedence.
+    // An isolated sequence is reconciled on its own, it is neither merged with
+    // earlier nor overridden by later commands, e.g. the off and the on step of
+    // a power cycle. Commands submitted between the steps of a power cycle are
+    // reconciled between them, the cycle still ends with turning its channels on.
+    void submit(const std::vector<step> &steps, switch_cb cb, bool isolated = false)
+    {
+        commands++;
+        const bool idle = batches.empty();
+        if (idle || batches.back().sealed || isolated)
+            batches.emplace_back();
+
+        auto &b = batches.back();
+        for (const auto &step:steps)
+        {
+            b.pending |= step.channels;
+            if (step.op == on)
+                b.desired |= step.channels;
+            else
+                b.desired -= step.channels;
+            if (step.op == off && step.channels == all_channels())
+                b.urgent = true;
+        }
+        b.sealed = isolated;
+        b.callbacks.push_back(std::move(cb));
+
+        if (!busy && idle)
+            schedule();
+    }
+
+    void write_metrics(std::ostream &os) const
+    {
+        os << "switch_commands "        << commands        << "\n";
+        os << "switch_reconciliations " << reconciliations << "\n";
+        os << "switch_requests "        << requests        << "\n";
+        os << "switch_elided "          << elided          << "\n";
+    }
+
+private:
+    void shutdown() override
+    {
+        timer.cancel();
+        batches.clear();
+    }
+
+    // Reconcile the first batch, when its window is closed. The window starts
+    // with its first command or, after a busy period, when the previous
+    // reconciliation is complete.
+    void schedule()
+    {
+        timer.expires_after(SWITCH_BATCH_WINDOW);
+        timer.async_wait([this](auto ec) {
+            if (ec)
+                return;
+            reconcile();
+        });
+    }
+
+    void reconcile()
+    {
+        auto b = std::move(batches.front());
+        batches.pop_front();
+
+        // Channels switched by the proxy after the model was read from the PDU
+        // are not known, the switch request may have failed unnoticed. The PDU
+        // may have been switched by other means as well, but the model is not
+        // older than STATUS_CACHE_TIME.
+        auto &status = boost::asio::use_service<status_fetcher>(io_context);
+        channel_mask known_on, known_off;
+        if (const auto observed_at = status.observed_at())
+        {
+            const auto observed = *status.observed();
+            channel_mask confirmed;
+            for (const auto ch:observed.reported_mask)
+                if (written[ch] < *observed_at)
+                    confirmed.insert(ch);
+            known_on  = confirmed & observed.on_mask;
+            known_off = confirmed - observed.on_mask;
+        }
+
+        const auto turn_on  = b.pending & b.desired;
+        const auto turn_off = b.pending - b.desired;
+        const auto send_on  = turn_on - known_on;
+        const auto send_off = turn_off - known_off;
+
+        std::vector<upstream_request> pipeline;
+        if (!send_off.empty())
+            pipeline.push_back(swith_request(send_off, off));
+        if (!send_on.empty())
+            pipeline.push_back(swith_request(send_on, on));
+
+        // "all off" goes first, even if later commands turned some channels on again
+        if (b.urgent)
+            for (auto &request:pipeline)
+                request.priority = upstream_priority::high;
+
+        reconciliations++;
+        requests += pipeline.size();
+        elided   += (!turn_off.empty() && send_off.empty()) + (!turn_on.empty() && send_on.empty());
+
+        auto done = [this, callbacks = std::move(b.callbacks), turn_on, turn_off, sent = send_on | send_off](auto ec) {
+            const auto now = std::chrono::steady_clock::now();
+            for (const auto ch:sent)
+                written[ch] = now;
+
+            auto &status = boost::asio::use_service<status_fetcher>(io_context);
+            if (ec)
+                status.invalidate();
+            else
+            {
+                status.update(turn_off, off);
+                status.update(turn_on, on);
+            }
+
+            busy = false;
+            if (!batches.empty())
+                schedule();
+
+            for (const auto &cb:callbacks)
+                cb(ec);
+        };
+        busy = true;
+
+        if (pipeline.empty())
+            return boost::asio::post(timer.get_executor(), [done = std::move(done)]() { done(boost::system::error_code{}); });
+
+        async_http_pipeline(io_context, std::move(pipeline), http::status::ok, [done = std::move(done)](auto ec, const auto &responses) {
+            done(ec);
+        });
+    }
+
+    // commands reconciled together
+    struct batch
+    {
+        channel_mask                          desired;          // target state of the pending channels
+        channel_mask                          pending;          // channels commanded
+        bool                                  urgent = false;   // contains "all off"
+        bool                                  sealed = false;   // takes no further commands
+        std::vector<switch_cb>                callbacks;
+    };
+
+    using time_point = std::chrono::steady_clock::time_point;
+
+    boost::asio::io_context   &io_context;
+    boost::asio::steady_timer timer;
+    std::deque<batch>         batches;      // waiting for reconciliation
+    bool                      busy = false; // reconciliation in progress
+    std::array<time_point, 8> written{};    // completion of the last switch request, by channel
+
+    std::uint64_t             commands        = 0;
+    std::uint64_t             reconciliations = 0;
+    std::uint64_t             requests        = 0;
+    std::uint64_t             elided          = 0;  // requests not sent, channels were already in their target state
+};
+
+// asyncronous sequence of switch requests, e.g. a scene. An isolated sequence
+// is not merged with other commands, see switch_reconciler::submit().
+template<typename CB>
+inline void async_switch_transaction(boost::asio::io_context &io_context, std::vector<switch_reconciler::step> steps, bool isolated, const CB &cb)
+{
+    boost::asio::dispatch(boost::asio::use_service<upstream_client>(io_context).executor(),
+        [&io_context, steps = std::move(steps), isolated, cb]() {
+            boost::asio::use_service<switch_reconciler>(io_context).submit(steps, [cb](auto ec) {
+                complete(cb, ec);
+            }, isolated);
+        });
+}
+
+template<typename CB>
+inline void async_switch_transaction(boost::asio::io_context &io_context, std::vector<switch_reconciler::step> steps, const CB &cb)
+{
+    async_switch_transaction(io_context, std::move(steps), false, cb);
+}
+
+template<typename CB>
+inline void async_switch_transaction(boost::asio::io_context &io_context, std::initializer_list<switch_reconciler::step> steps, const CB &cb)
+{
+    async_switch_transaction(io_context, std::vector<switch_reconciler::step>(steps), cb);
+}
+
+// asyncronous switch request, may be merged with concurrent requests
+template<typename CB>
+inline void async_switch_transaction(boost::asio::io_context &io_context, channel_mask channels, op_t op, const CB &cb)
+{
+    async_switch_transaction(io_context, {{channels, op}}, cb);
+}
+
+// Switch a sequence of steps at the given time, without anybody waiting for
+// the result, e.g. the on step of a power cycle, whose client went away.
+static void switch_at(boost::asio::io_context &io_context, std::vector<switch_reconciler::step> steps, bool isolated, std::chrono::steady_clock::time_point at)
+{
+    auto timer = std::make_shared<boost::asio::steady_timer>(boost::asio::use_service<upstream_client>(io_context).executor(), at);
+    timer->async_wait([&io_context, timer, steps = std::move(steps), isolated](auto ec) {
+        if (ec)
+            return;
+        async_switch_transaction(io_context, std::move(steps), isolated, [](boost::system::error_code) {});
+    });
+}
+
+// first path element of a proxy request
+enum class route_t { show, metrics, events, ws, api, limits, all, channel, set };
+
+struct route
+{
+    route_t type = route_t::show;
+    channel ch   = ch1;
+};
+
+static constexpr auto route_table = []() {
+    constexpr std::size_t fixed = 8;
+    std::array<hash_entry<route>, fixed + std::size(channel_names)> entries{{
+        {"show",    {route_t::show}},
+        {"metrics", {route_t::metrics}},
+        {"events",  {route_t::events}},
+        {"ws",      {route_t::ws}},
+        {"api",     {route_t::api}},
+        {"limits",  {route_t::limits}},
+        {"all",     {route_t::all}},
+        {"set",     {route_t::set}},
+    }};
+    for (std::size_t i = 0; i < std::size(channel_names); i++)
+        entries[fixed + i] = { channel_names[i].first, {route_t::channel, channel_names[i].second} };
+    return perfect_hash{entries};
+}();
+static_assert(route_table.valid(), "channel name in config.h conflicts with a proxy request (show, metrics, events, ws, api, limits, all, set)");
+
+// query of a channel request
+enum class command_t { on, off, cycle };
+
+static constexpr perfect_hash command_table{std::array<hash_entry<command_t>, 3>{{
+    {"on",    command_t::on},
+    {"off",   command_t::off},
+    {"cycle", command_t::cycle},
+}}};
+
+// off time of a power cycle, unless the request gives a duration_ms
+static constexpr std::chrono::milliseconds power_cycle_duration = std::chrono::seconds(5);
+
+// duration_ms of a power cycle, 0 .. 600000. Returns false, if it is out of range.
+static bool parse_cycle_duration(std::int64_t ms, std::chrono::milliseconds &duration)
+{
+    if (ms < 0 || ms > 600000)
+        return false;
+    duration = std::chrono::milliseconds(ms);
+    return true;
+}
+
+// Batch of operations for the JSON API (/api/v1), in order:
+//     {"operations": [
+//         {"op": "on",    "channels": ["ch1", 2]},
+//         {"op": "off",   "channels": "all"},
+//         {"op": "cycle", "mask": 5, "duration_ms": 3000},
+//         {"op": "scene", "scene": "<name>"}
+//     ]}
+// Channels are given by name or number, "all", or as mask with one bit per channel.
+// The batch is compiled into stages: the operations of a stage only set the
+// desired state of their channels, so a stage takes at most one "off" and one
+// "on" request. A power cycle ends a stage, its channels are turned on again
+// in the next one, after its duration. Both stages of a power cycle are
+// isolated from commands of other clients, see switch_reconciler::submit().
+// If the client goes away during the duration, the next stage still turns the
+// channels on again after it, later stages are not run.
+struct api_batch
+{
+    struct stage
+    {
+        channel_mask              off;
+        channel_mask              on;
+        std::chrono::milliseconds wait{};         // before the next stage
+        bool                      isolated = false; // off or on step of a power cycle
+
+        // "off" goes first
+        std::vector<switch_reconciler::step> steps() const
+        {
+            std::vector<switch_reconciler::step> ret;
+            if (!off.empty())
+                ret.push_back({ off, op_t::off });
+            if (!on.empty())
+                ret.push_back({ on, op_t::on });
+            return ret;
+        }
+    };
+
+    struct operation
+    {
+        std::string op;
+        std::size_t first_stage;
+        std::size_t last_stage;
+    };
+
+    std::vector<operation> operations;
+    std::vector<stage>     stages{ 1 };
+
+    void set(channel_mask channels, op_t op)
+    {
+        auto &s = stages.back();
+        if (op == on)
+        {
+            s.on  |= channels;
+            s.off -= channels;
+        }
+        else
+        {
+            s.off |= channels;
+            s.on  -= channels;
+        }
+    }
+};
+
+static bool parse_api_channels(const boost::json::object &operation, channel_mask &channels)
+{
+    if (const auto mask = operation.if_contains("mask"))
+    {
+        if (!mask->is_int64() || mask->as_int64() < 0 || mask->as_int64() > 0xff)
+            return false;
+        channels |= channel_mask::from_bits(std::uint8_t(mask->as_int64()));
+    }
+
+    if (const auto list = operation.if_contains("channels"))
+    {
+        if (list->is_string() && iequals(std::string_view{ list->as_string() }, "all"))
+            channels = all_channels();
+        else if (!list->is_array())
+            return false;
+        else for (const auto &item:list->as_array())
+        {
+            if (item.is_string())
+            {
+                const auto ch = channel_table.find(std::string_view{ item.as_string() });
+                if (!ch)
+                    return false;
+                channels.insert(*ch);
+            }
+            else if (item.is_int64() && item.as_int64() >= 1 && item.as_int64() <= 8)
+                channels.insert(channel(item.as_int64() - 1));
+            else
+                return false;
+        }
+    }
+
+    return !channels.empty() && (channels - all_channels()).empty();
+}
+
+// returns false and sets error on invalid input.
+static bool parse_api_batch(std::string_view body, api_batch &batch, std::string &error)
+{
+    boost::system::error_code ec;
+    const auto document = boost::json::parse(body, ec);
+    if (ec)
+    {
+        error = "invalid JSON: " + ec.message();
+        return false;
+    }
+
+    const auto operations = document.is_object() ? document.as_object().if_contains("operations") : nullptr;
+    if (!operations || !operations->is_array())
+    {
+        error = "operations missing";
+        return false;
+    }
+
+    for (const auto &item:operations->as_array())
+    {
+        const auto index = std::to_string(batch.operations.size());
+        const auto op    = item.is_object() ? item.as_object().if_contains("op") : nullptr;
+        if (!op || !op->is_string())
+        {
+            error = "operation " + index + ": op missing";
+            return false;
+        }
+
+        const auto &operation = item.as_object();
+        api_batch::operation result{ std::string(op->as_string()), batch.stages.size() - 1, batch.stages.size() - 1 };
+        if (result.op == "scene")
+        {
+            const auto name  = operation.if_contains("scene");
+            const auto scene = name && name->is_string() ? find_scene(std::string_view{ name->as_string() }) : nullptr;
+            if (!scene)
+            {
+                error = "operation " + index + ": unknown scene";
+                return false;
+            }
+            batch.set(scene->off, off);
+            batch.set(scene->on, on);
+        }
+        else
+        {
+            channel_mask channels;
+            if (!parse_api_channels(operation, channels))
+            {
+                error = "operation " + index + ": invalid channels";
+                return false;
+            }
+
+            if (result.op == "on" || result.op == "off")
+                batch.set(channels, result.op == "on" ? on : off);
+            else if (result.op == "cycle")
+            {
+                std::chrono::milliseconds duration = power_cycle_duration;
+                if (const auto value = operation.if_contains("duration_ms"))
+                {
+                    if (!value->is_int64() || !parse_cycle_duration(value->as_int64(), duration))
+                    {
+                        error = "operation " + index + ": invalid duration_ms";
+                        return false;
+                    }
+                }
+                batch.set(channels, off);
+                batch.stages.back().wait     = duration;
+                batch.stages.back().isolated = true;
+                batch.stages.emplace_back();
+                batch.stages.back().isolated = true;
+                batch.set(channels, on);
+            }
+            else
+            {
+                error = "operation " + index + ": unknown op";
+                return false;
+            }
+        }
+        result.last_stage = batch.stages.size() - 1;
+        batch.operations.push_back(std::move(result));
+    }
+    return true;
+}
+
+template<typename S>
+static S strip_path_element(S &path)
+{
+    static constexpr char delimiter='/';
+    std::size_t n;
+    while ((n = path.find(delimiter))==0)
+        path = path.substr(1);
+    
+    S ret;
+    if (n == std::string::npos)
+    {
+        ret = path;
+        path={};
+    }
+    else
+    {
+        ret = path.substr(0, n);
+        path = path.substr(n+1);
+        while ((n = path.find(delimiter))==0)
+            path = path.substr(1);
+    }
+    return ret;
+}
+
+// strong entity tag of a resource rendered from the given state
+static std::string make_etag(char resource, std::uint32_t state)
+{
+    std::ostringstream os;
+    os << '"' << resource << '-' << std::hex << config_version << '-' << state << '"';
+    return os.str();
+}
+
+// If-None-Match: "*" or a list of entity tags, compared weakly
+static bool etag_matches(std::string_view if_none_match, std::string_view etag)
+{
+    while (!if_none_match.empty())
+    {
+        auto n = if_none_match.find(',');
+        auto tag = if_none_match.substr(0, n);
+        if_none_match = n == std::string_view::npos ? std::string_view{} : if_none_match.substr(n + 1);
+
+        while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t'))
+            tag.remove_prefix(1);
+        while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t'))
+            tag.remove_suffix(1);
+        if (tag.starts_with("W/"))
+            tag.remove_prefix(2);
+
+        if (tag == "*" || tag == etag)
+            return true;
+    }
+    return false;
+}
+
+#ifdef PROXY_BIND_PORT
+namespace http = boost::beast::http;
+using namespace std::string_literals;
+using tcp = boost::asio::ip::tcp;
+// token bucket: requests per second and burst size, a rate of 0 is unlimited
+struct rate_limit
+{
+    double rate;
+    double burst;
+};
+
+enum class request_class { read, write, cycle, ws };
+
+static constexpr std::string_view request_class_names[] = { "read", "write", "cycle", "ws" };
+static constexpr std::size_t      request_classes       = std::size(request_class_names);
+
+struct admission_limits
+{
+    unsigned                                max_sessions;
+    unsigned                                max_sessions_per_client;
+    std::array<rate_limit, request_classes> rates;    // by request_class
+};
+
+// Admission control of proxy clients, shared by all threads and shards.
+// At accept time, connections beyond max_sessions in total or beyond
+// max_sessions_per_client from one client address are closed right away.
+// Every request takes a token from the bucket of its class of its client
+// address, requests without a token are answered with 429. IPv6 clients
+// share the buckets of their /64 prefix. At most max_buckets clients are
+// tracked, the least recently seen one is forgotten for a new one.
+// The limits can be changed at runtime, see /limits.
+class admission_control
+{
+public:
+    // an admitted session, released on destruction
+    class ticket
+    {
+        friend class admission_control;
+
+        boost::asio::ip::address address;
+        bool                     valid = false;
+
+        explicit ticket(const boost::asio::ip::address &address):
+            address{address},
+            valid{true}
+        {
+        }
+
+    public:
+        ticket(ticket &&other) noexcept:
+            address{other.address},
+            valid{std::exchange(other.valid, false)}
+        {
+        }
+        ticket& operator=(ticket&&) = delete;
+
+        ~ticket()
+        {
+            if (valid)
+                instance().release(address);
+        }
+
+        const boost::asio::ip::address &client() const { return address; }
+    };
+
+    static admission_control &instance()
+    {
+        static admission_control control;
+        return control;
+    }
+
+    std::optional<ticket> admit(const boost::asio::ip::address &client)
+    {
+        std::lock_guard lock{ mutex };
+        if (sessions >= limits.max_sessions)
+        {
+            rejected++;
+            return std::nullopt;
+        }
+        if (const auto it = clients.find(client); it != clients.end() && it->second >= limits.max_sessions_per_client)
+        {
+            rejected_client++;
+            return std::nullopt;
+        }
+
+        clients[client]++;
+        sessions++;
+        return ticket{ client };
+    }
+
+    // time until a token is available, if the request is to be rejected
+    std::optional<std::chrono::seconds> throttle(const boost::asio::ip::address &client, request_class cls)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        std::lock_guard lock{ mutex };
+
+        const auto &limit = limits.rates[std::size_t(cls)];
+        if (limit.rate <= 0)
+            return std::nullopt;
+
+        if (now >= next_prune)
+        {
+            prune(now);
+            next_prune = now + std::chrono::seconds(1);
+        }
+
+        auto &bucket = buckets_of(rate_key(client), now)[std::size_t(cls)];
+        bucket.tokens = std::min(limit.burst, bucket.tokens + limit.rate * std::chrono::duration<double>(now - bucket.time).count());
+        bucket.time   = now;
+        if (bucket.tokens >= 1)
+        {
+            bucket.tokens -= 1;
+            return std::nullopt;
+        }
+
+        limited[std::size_t(cls)]++;
+        return std::max(std::chrono::seconds(1), std::chrono::seconds(std::int64_t(std::ceil((1 - bucket.tokens) / limit.rate))));
+    }
+
+    admission_limits get_limits() const
+    {
+        std::lock_guard lock{ mutex };
+        return limits;
+    }
+
+    void set_limits(const admission_limits &new_limits)
+    {
+        std::lock_guard lock{ mutex };
+        limits = new_limits;
+    }
+
+    void write_metrics(std::ostream &os) const
+    {
+        std::lock_guard lock{ mutex };
+        os << "admission_sessions "                << sessions                      << "\n";
+        os << "admission_max_sessions "            << limits.max_sessions            << "\n";
+        os << "admission_max_sessions_per_client " << limits.max_sessions_per_client << "\n";
+        os << "admission_rejected "                << rejected                      << "\n";
+        os << "admission_rejected_client "         << rejected_client               << "\n";
+        os << "admission_clients "                 << buckets.size()                << "\n";
+        os << "admission_clients_evicted "         << evicted                       << "\n";
+        for (std::size_t i = 0; i < limited.size(); i++)
+        {
+            os << "admission_rate_" << request_class_names[i] << " "       << limits.rates[i].rate  << "\n";
+            os << "admission_burst_" << request_class_names[i] << " "      << limits.rates[i].burst << "\n";
+            os << "admission_rate_limited_" << request_class_names[i] << " " << limited[i]           << "\n";
+        }
+    }
+
+private:
+    struct bucket
+    {
+        double                                tokens;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    struct client_buckets
+    {
+        boost::asio::ip::address            address;
+        std::array<bucket, request_classes> buckets;   // by request_class
+    };
+    using bucket_list = std::list<client_buckets>;
+
+    static constexpr std::size_t max_buckets = 4096;
+
+    admission_control() = default;
+
+    // IPv6 clients are limited by their /64 prefix, the smallest network
+    // assigned to a host usually
+    static boost::asio::ip::address rate_key(const boost::asio::ip::address &client)
+    {
+        if (!client.is_v6())
+            return client;
+        const auto v6 = client.to_v6();
+        if (v6.is_v4_mapped())
+            return boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, v6);
+        auto bytes = v6.to_bytes();
+        std::fill(bytes.begin() + 8, bytes.end(), 0);
+        return boost::asio::ip::address_v6{ bytes };
+    }
+
+    // buckets of a client, most recently used first
+    std::array<bucket, request_classes> &buckets_of(const boost::asio::ip::address &key, std::chrono::steady_clock::time_point now)
+    {
+        if (const auto it = bucket_index.find(key); it != bucket_index.end())
+        {
+            buckets.splice(buckets.begin(), buckets, it->second);
+            return it->second->buckets;
+        }
+
+        if (buckets.size() >= max_buckets)
+        {
+            bucket_index.erase(buckets.back().address);
+            buckets.pop_back();
+            evicted++;
+        }
+        buckets.push_front({ key, {} });
+        for (std::size_t i = 0; i < limits.rates.size(); i++)
+            buckets.front().buckets[i] = { limits.rates[i].burst, now };
+        bucket_index.emplace(key, buckets.begin());
+        return buckets.front().buckets;
+    }
+
+    void release(const boost::asio::ip::address &client)
+    {
+        std::lock_guard lock{ mutex };
+        sessions--;
+        if (const auto it = clients.find(client); it != clients.end() && --it->second == 0)
+            clients.erase(it);
+    }
+
+    // Forget the least recently seen clients, whose buckets are full again.
+    // Stops at the first client with tokens missing, so a call is cheap.
+    void prune(std::chrono::steady_clock::time_point now)
+    {
+        const auto full = [&](const client_buckets &item) {
+            for (std::size_t i = 0; i < item.buckets.size(); i++)
+            {
+                const auto &limit = limits.rates[i];
+                if (limit.rate > 0 && item.buckets[i].tokens + limit.rate * std::chrono::duration<double>(now - item.buckets[i].time).count() < limit.burst)
+                    return false;
+            }
+            return true;
+        };
+        while (!buckets.empty() && full(buckets.back()))
+        {
+            bucket_index.erase(buckets.back().address);
+            buckets.pop_back();
+        }
+    }
+
+    mutable std::mutex                                                 mutex;
+    admission_limits                                                   limits{ PROXY_MAX_SESSIONS, PROXY_MAX_SESSIONS_PER_CLIENT,
+                                                                               {{ PROXY_RATE_READ, PROXY_RATE_WRITE, PROXY_RATE_CYCLE, PROXY_RATE_WS }} };
+    unsigned                                                           sessions = 0;
+    std::unordered_map<boost::asio::ip::address, unsigned>             clients;   // sessions per client
+    bucket_list                                                        buckets;   // most recently used first
+    std::unordered_map<boost::asio::ip::address, bucket_list::iterator> bucket_index;
+    std::chrono::steady_clock::time_point                              next_prune;
+
+    std::uint64_t                                                      rejected        = 0;
+    std::uint64_t                                                      rejected_client = 0;
+    std::array<std::uint64_t, request_classes>                         limited{};
+    std::uint64_t                                                      evicted         = 0;
+};
+
+// The limits as JSON text. boost::json writes 0.2 as 2E-1 and 20.0 as 2E1,
+// so rates and bursts are written in fixed notation, without trailing zeros.
+static std::string to_json(const admission_limits &limits)
+{
+    const auto number = [](double value) {
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(6) << value;
+        auto text = os.str();
+        text.erase(text.find_last_not_of('0') + 1);
+        if (text.back() == '.')
+            text.pop_back();
+        return text;
+    };
+
+    std::ostringstream os;
+    os << "{\"max_sessions\":"            << limits.max_sessions
+       << ",\"max_sessions_per_client\":" << limits.max_sessions_per_client
+       << ",\"rates\":{";
+    for (std::size_t i = 0; i < limits.rates.size(); i++)
+        os << (i ? "," : "") << '"' << request_class_names[i] << "\":{\"rate\":" << number(limits.rates[i].rate)
+           << ",\"burst\":" << number(limits.rates[i].burst) << '}';
+    os << "}}";
+    return os.str();
+}
+
+// Update limits with the members of a JSON object, e.g.
+//     {"max_sessions": 100, "rates": {"cycle": {"rate": 0.1, "burst": 1}}}
+// returns false and sets error on invalid input.
+static bool parse_admission_limits(std::string_view body, admission_limits &limits, std::string &error)
+{
+    boost::system::error_code ec;
+    const auto document = boost::json::parse(body, ec);
+    if (ec || !document.is_object())
+    {
+        error = "invalid JSON";
+        return false;
+    }
+
+    const auto count = [&](const boost::json::object &object, std::string_view name, unsigned &value) {
+        const auto item = object.if_contains(name);
+        if (!item)
+            return true;
+        if (!item->is_int64() || item->as_int64() < 1 || item->as_int64() > 0xffff)
+        {
+            error = std::string(name) + ": integer 1..65535 expected";
+            return false;
+        }
+        value = unsigned(item->as_int64());
+        return true;
+    };
+    const auto number = [&](const boost::json::object &object, std::string_view name, double &value) {
+        const auto item = object.if_contains(name);
+        if (!item)
+            return true;
+        if (!item->is_number() || item->to_number<double>() < 0)
+        {
+            error = std::string(name) + ": number >= 0 expected";
+            return false;
+        }
+        value = item->to_number<double>();
+        return true;
+    };
+
+    const auto &object = document.as_object();
+    if (!count(object, "max_sessions", limits.max_sessions) || !count(object, "max_sessions_per_client", limits.max_sessions_per_client))
+        return false;
+
+    if (const auto rates = object.if_contains("rates"))
+    {
+        if (!rates->is_object())
+        {
+            error = "rates: object expected";
+            return false;
+        }
+        for (std::size_t i = 0; i < limits.rates.size(); i++)
+        {
+            const auto rate = rates->as_object().if_contains(request_class_names[i]);
+            if (!rate)
+                continue;
+            if (!rate->is_object())
+            {
+                error = std::string(request_class_names[i]) + ": object expected";
+                return false;
+            }
+            if (!number(rate->as_object(), "rate", limits.rates[i].rate) || !number(rate->as_object(), "burst", limits.rates[i].burst))
+                return false;
+        }
+    }
+
+    for (const auto &limit:limits.rates)
+        if (limit.rate > 0 && limit.burst < 1)
+        {
+            error = "burst must be at least 1";
+            return false;
+        }
+    return true;
+}
+
+// The root page only depends on the switch states and the state of the
+// circuit breaker, so each of the at most 3 * 256 variants is rendered once
+// and then shared by all responses showing it. The rows depend on the
+// reported channels as well, if they change, the pages are built again.
+class root_page
+{
+public:
+    static std::string etag(const channel_states &switch_states, circuit_breaker::state_t breaker)
+    {
+        return make_etag('r', std::uint32_t(breaker) << 16 | std::uint32_t(switch_states.reported_mask.to_bits()) << 8 | switch_states.on_mask.to_bits());
+    }
+
+    static std::shared_ptr<const std::string> get(const channel_states &switch_states, circuit_breaker::state_t breaker)
+    {
+        static std::mutex                                               mutex;
+        static channel_mask                                             reported;
+        static std::array<std::shared_ptr<const std::string>, 3 * 256> pages;
+
+        std::lock_guard lock{ mutex };
+        if (switch_states.reported_mask != reported)
+        {
+            pages.fill(nullptr);
+            reported = switch_states.reported_mask;
+        }
+        auto &page = pages[std::size_t(breaker) * 256 + switch_states.on_mask.to_bits()];
+        if (!page)
+            page = std::make_shared<const std::string>(render(switch_states, breaker));
+        return page;
+    }
+
+private:
+    static constexpr std::string_view head = R"---(
+<html>
+    <head>
+        <title>power switch</title>
+        <meta name="viewport" content="width=device-width, initial-scale=1.0">
+        <style>
+.on {
+  background-color: Chartreuse;
+}
+.off {
+}
+.state {
+  text-align: center;
+}
+table, th, td {
+  border: 1px solid;
+  border-collapse: collapse;
+}
+#overlay.dim {
+  display:inline;
+}
+
+#overlay {
+  background-color: rgba(0,0,0,0.2);
+  display:none;
+  position:fixed;
+  left:0;
+  top: 0;
+  width:100%;
+  height:100%;
+}
+        </style>
+        <script>
+
+function set_switch(request)
+{
+  // din window when operation is in progress
+  document.getElementById('overlay').classList.add('dim');
+
+  const xhr = new XMLHttpRequest();
+  xhr.open("GET", "/" + request, true);
+  xhr.onload = (e) => {
+    if (xhr.status !== 200) {
+      console.error(xhr.statusText);
+    }
+  };
+  xhr.onerror = (e) => {
+    console.error(xhr.statusText);
+  };
+  // the new states arrive as event
+  xhr.onloadend = (e) => {
+    document.getElementById('overlay').classList.remove('dim');
+  };
+  xhr.send(null);
+}
+
+// update the table in place, whenever the switch states change
+window.addEventListener('DOMContentLoaded', () => {
+  const events = new EventSource("/events");
+  events.onmessage = (e) => {
+    const states = JSON.parse(e.data);
+    for (const name in states) {
+      const cell = document.querySelector("tr." + CSS.escape(name) + " td.state");
+      if (cell) {
+        cell.className = "state " + states[name];
+        cell.textContent = states[name];
+      }
+    }
+  };
+  events.addEventListener("breaker", (e) => {
+    document.querySelector("p.upstream").textContent = "PDU circuit breaker: " + JSON.parse(e.data);
+  });
+});
+
+        </script>
+    </head>
+    <body>
+        <h1>power switch</h1>
+)---";
+
+    static constexpr std::string_view tail = R"---(
+            <tr>
+                <td>all</td>
+                <td/>
+                <td class='off_button'><button onclick='set_switch("all?off")'>off</button></td>
+                <td class='on_button' >
+                    <!-- <button onclick='set_switch("all?on")' >on</button> -->
+                </td>
+            </tr>
+        </table>
+
+        <div id='overlay'/>
+
+    </body>
+</html>
+)---";
+
+    // scene buttons and table header, between the circuit breaker state and the rows
+    static const std::string &middle()
+    {
+        static const std::string middle = []() {
+            std::string s{R"---(
+        <h2>Scenes:</h2>
+        <ul>
+)---"};
+            for (const auto &scene: scenes)
+                s.append("<li><button onclick='set_switch(\"set/").append(scene.first).append("\")'>").append(scene.first).append("</button></li>\n");
+            s.append(R"---(
+        </ul>
+
+        <h2>Channels:</h2>
+        <table>
+            <tr><th>channel</th><th>state</th><th colspan='2'>command</th></tr>
+)---");
+            return s;
+        }();
+        return middle;
+    }
+
+    static std::string render(const channel_states &switch_states, circuit_breaker::state_t breaker)
+    {
+        std::string page;
+        page.reserve(head.size() + middle().size() + tail.size() + 8 * 256);
+        page.append(head);
+        page.append("<p class='upstream'>PDU circuit breaker: ").append(circuit_breaker::name(breaker)).append("</p>\n");
+        page.append(middle());
+        for(const auto &state:switch_states)
+        {
+            const std::string_view on_off = state.state ? "on" : "off";
+            page.append("<tr class='").append(state.name).append("'>");
+            page.append("<td class='channel'>").append(state.name).append("</td>");
+            page.append("<td class='state ").append(on_off).append("'>").append(on_off).append("</td>");
+
+            page.append("<td class='off_button'><button onclick='set_switch(\"").append(state.name).append("?off\")'>off</button></td>");
+            page.append("<td class='on_button'><button onclick='set_switch(\"").append(state.name).append("?on\")'>on</button></td>");
+
+            page.append("</tr>\n");
+        }
+        page.append(tail);
+        return page;
+    }
+};
+
+class proxy_server
+{
+
+    // Command channel for automation clients, a WebSocket at /ws.
+    // Every text message is a command:
+    //     <channels> <on|off> [<id>]         channels: a name, "all" or a list like "153"
+    //     <channels> cycle [duration_ms=<ms>] [<id>]
+    //     set <scene> [<id>]
+    // duration_ms is the off time of a cycle, 0 .. 600000 like for /api/v1.
+    // Commands run concurrently and go through the switch_reconciler like
+    // HTTP requests. They have a rate limit of their own, ws, sized for
+    // thousands of commands per second, only cycles are limited like HTTP
+    // requests, as cycle. Each is answered with "ok [<id>]" or "error [<id>] <reason>",
+    // in the order they complete. Changes of the switch states are sent as
+    // "state <channel>=<on|off> ...".
+    // A cycle is answered after its on step. Commands for its channels during
+    // the off time take effect, but the cycle turns the channels on at its end.
+    // Flow control: a command holds one of PROXY_WS_MAX_IN_FLIGHT slots until
+    // its answer has been written, no further messages are read while all are taken.
+    class ws_session : public std::enable_shared_from_this<ws_session>
+    {
+        boost::asio::io_context&                                  upstream_context;
+        admission_control::ticket                                 ticket;
+        boost::beast::websocket::stream<boost::beast::tcp_stream> ws;
+        boost::beast::flat_buffer                                 buffer;
+        http::request<http::string_body>                          upgrade_request;
+        std::deque<std::pair<std::string, bool>>                  outgoing;  // message, answers a command
+        unsigned                                                  in_flight = 0;
+        bool                                                      reading   = false;
+        bool                                                      closed    = false;
+
+        static std::string_view next_token(std::string_view &message)
+        {
+            while (!message.empty() && message.front() == ' ')
+                message.remove_prefix(1);
+            const auto n = std::min(message.find(' '), message.size());
+            const auto token = message.substr(0, n);
+            message.remove_prefix(n);
+            return token;
+        }
+
+        static std::string state_message(const channel_states &switch_states)
+        {
+            std::ostringstream os;
+            os << "state";
+            for(const auto &state:switch_states)
+                os << ' ' << state.name << '=' << (state.state ? "on" : "off");
+            return os.str();
+        }
+
+    public:
+        ws_session(boost::asio::io_context& upstream_context, boost::beast::tcp_stream &&s, admission_control::ticket &&ticket):
+            upstream_context{ upstream_context },
+            ticket{ std::move(ticket) },
+            ws{ std::move(s) }
+        {
+        }
+
+        void run(http::request<http::string_body> &&request)
+        {
+            upgrade_request = std::move(request);
+            boost::beast::get_lowest_layer(ws).expires_never();
+            ws.set_option(boost::beast::websocket::stream_base::timeout::suggested(boost::beast::role_type::server));
+            ws.text(true);
+            ws.async_accept(upgrade_request, [This = shared_from_this()](auto ec) {
+                if (ec)
+                    return This->stop(ec);
+
+                boost::asio::dispatch(This->upstream().executor(), [This]() {
+                    boost::asio::use_service<status_fetcher>(This->upstream_context).subscribe(This.get(), [This](const auto &switch_states) {
+                        boost::asio::dispatch(This->ws.get_executor(), [This, message = state_message(switch_states)]() {
+                            This->send_state(message);
+                        });
+                    });
+                });
+                This->read();
+            });
+        }
+
+    private:
+        upstream_client& upstream()
+        {
+            return boost::asio::use_service<upstream_client>(upstream_context);
+        }
+
+        // callback answering a command
+        auto completion(std::string id)
+        {
+            return boost::asio::bind_executor(ws.get_executor(), [This = shared_from_this(), id = std::move(id)](auto ec) {
+                This->answer(id, ec ? ec.message() : std::string{});
+            });
+        }
+
+        void read()
+        {
+            if (reading || closed || in_flight >= PROXY_WS_MAX_IN_FLIGHT)
+                return;
+
+            reading = true;
+            ws.async_read(buffer, [This = shared_from_this()](auto ec, auto bytes_transferred) {
+                This->reading = false;
+                if (ec)
+                    return This->stop(ec);
+
+                This->in_flight++;
+                This->execute({ static_cast<const char*>(This->buffer.data().data()), This->buffer.size() });
+                This->buffer.consume(This->buffer.size());
+                This->read();
+            });
+        }
+
+        void execute(std::string_view message)
+        {
+            constexpr std::string_view duration_option = "duration_ms=";
+
+            const auto target  = next_token(message);
+            const auto command = next_token(message);
+            auto       option  = next_token(message);
+            std::string_view duration_ms;
+            if (option.starts_with(duration_option))
+            {
+                duration_ms = option.substr(duration_option.size());
+                option      = next_token(message);
+            }
+            std::string id{ option };
+
+            if (iequals(target, "set"))
+            {
+                const auto scene = find_scene(command);
+                if (!scene)
+                    return answer(id, "unknown scene");
+                if (throttled(id, request_class::ws))
+                    return;
+                return async_switch_transaction(upstream_context, {{scene->off, off}, {scene->on, on}}, completion(std::move(id)));
+            }
+
+            channel_mask channels;
+            if (const auto ch = channel_table.find(target))
+                channels.insert(*ch);
+            else if (iequals(target, "all"))
+                channels = all_channels();
+            else if (target.empty() || !parse_channel_list(target, channels))
+                return answer(id, "unknown channel");
+
+            const auto op = command_table.find(command);
+            if (!op)
+                return answer(id, "unknown command");
+
+            auto duration = power_cycle_duration;
+            if (!duration_ms.empty())
+            {
+                std::int64_t ms = -1;
+                const auto [end, ec] = std::from_chars(duration_ms.data(), duration_ms.data() + duration_ms.size(), ms);
+                if (*op != command_t::cycle || ec != std::errc{} || end != duration_ms.data() + duration_ms.size() || !parse_cycle_duration(ms, duration))
+                    return answer(id, "invalid duration_ms");
+            }
+            if (throttled(id, *op == command_t::cycle ? request_class::cycle : request_class::ws))
+                return;
+
+            switch (*op)
+            {
+                case command_t::on:    return async_switch_transaction(upstream_context, channels, on, completion(std::move(id)));
+                case command_t::off:   return async_switch_transaction(upstream_context, channels, off, completion(std::move(id)));
+                case command_t::cycle: return power_cycle(channels, duration, std::move(id));
+            }
+        }
+
+        // answer "too many requests", if the client has no token left for a command of this class
+        bool throttled(const std::string &id, request_class cls)
+        {
+            if (!admission_control::instance().throttle(ticket.client(), cls))
+                return false;
+            answer(id, "too many requests");
+            return true;
+        }
+
+        void power_cycle(channel_mask channels, std::chrono::milliseconds duration, std::string id)
+        {
+            // both steps are isolated, so neither is merged away by other commands
+            async_switch_transaction(upstream_context, {{channels, off}}, true, boost::asio::bind_executor(ws.get_executor(),
+                [This = shared_from_this(), channels, duration, id = std::move(id)](auto ec) {
+                    if (ec)
+                        return This->answer(id, ec.message());
+
+                    auto timer = std::make_shared<boost::asio::steady_timer>(This->ws.get_executor(), duration);
+                    timer->async_wait([This, timer, channels, id](auto ec) {
+                        if (ec)
+                            return This->answer(id, ec.message());
+                        async_switch_transaction(This->upstream_context, {{channels, on}}, true, This->completion(id));
+                    });
+                }));
+        }
+
+        void answer(std::string_view id, std::string_view error = {})
+        {
+            std::string message{ error.empty() ? "ok" : "error" };
+            if (!id.empty())
+                message.append(" ").append(id);
+            if (!error.empty())
+                message.append(" ").append(error);
+            send(std::move(message), true);
+        }
+
+        // only the latest of the state messages waiting to be written is kept
+        void send_state(std::string message)
+        {
+            for (std::size_t i = 1; i < outgoing.size(); i++)
+                if (!outgoing[i].second)
+                    return outgoing[i].first.swap(message);
+            send(std::move(message), false);
+        }
+
+        void send(std::string message, bool reply)
+        {
+            if (closed)
+                return;
+            outgoing.emplace_back(std::move(message), reply);
+            if (outgoing.size() == 1)
+                write();
+        }
+
+        void write()
+        {
+            ws.async_write(boost::asio::buffer(outgoing.front().first), [This = shared_from_this()](auto ec, auto bytes_transferred) {
+                if (ec)
+                    return This->stop(ec);
+
+                if (This->outgoing.front().second)
+                    This->in_flight--;
+                This->outgoing.pop_front();
+                if (!This->outgoing.empty())
+                    This->write();
+                This->read();
+            });
+        }
+
+        void stop(boost::system::error_code ec)
+        {
+            if (closed)
+                return;
+            closed = true;
+            if (ec != boost::beast::websocket::error::closed && ec != boost::asio::error::operation_aborted && ec != boost::asio::error::eof)
+                std::cerr << "websocket failed: " << ec.message() << "\n";
+
+            boost::asio::dispatch(upstream().executor(), [This = shared_from_this()]() {
+                boost::asio::use_service<status_fetcher>(This->upstream_context).unsubscribe(This.get());
+            });
+            boost::system::error_code e;
+            boost::beast::get_lowest_layer(ws).socket().close(e);
+        }
+    };
+
+    // A session runs on its own strand (the executor of its socket), so
+    // sessions can be served by several threads. Callbacks from the upstream
+    // layer are bound to this strand with bind_executor().
+    // upstream_context hosts the upstream services, it may be the io_context
+    // of another shard.
+    class session : public std::enable_shared_from_this<session>
+    {
+        boost::asio::io_context& upstream_context;
+        admission_control::ticket        ticket;
+        boost::beast::tcp_stream         s;
+        boost::beast::flat_buffer        buffer;
+        http::request<http::string_body> request;
+        boost::asio::deadline_timer      timer;
+        unsigned                         requests = 0;  // received on this connection
+
+        // batch waiting between its stages, see watch_for_close()
+        static constexpr std::size_t     max_pipelined = 64 * 1024;
+        bool                             watching = false;
+
+        // Server-Sent Events stream
+        bool                             streaming = false;
+        bool                             writing   = false;
+        std::string                      outgoing;
+        std::string                      next_event;
+        std::string                      next_breaker_event;
+
+    public:
+        explicit session(boost::asio::io_context& upstream_context, tcp::socket&& s, admission_control::ticket &&ticket) :
+            upstream_context{ upstream_context },
+            ticket{ std::move(ticket) },
+            s{ std::move(s) },
+            timer{ this->s.get_executor() }
+        {
+        }
+        session() = delete;
+        session(const session&) = delete;
+        session& operator=(const session&) = delete;
+
+        void close()
+        {
+            boost::system::error_code e;
+            s.socket().shutdown(tcp::socket::shutdown_send, e);
+            s.socket().close(e);
+        }
+
+        // Read the next request. Pipelined requests are left in buffer by the
+        // previous read and are answered one after another, in order.
+        void start()
+        {
+            request = {};
+            s.expires_after(PROXY_IDLE_TIMEOUT);
+            boost::beast::http::async_read(s, buffer, request,
+                [This = shared_from_this()](auto ec, auto bytes_transferred) {
+                    if (ec)
+                    {
+                        if (ec == http::error::end_of_stream || ec == boost::beast::error::timeout)
+                            This->close();
+                        else if (ec != boost::asio::error::operation_aborted)
+                            std::cerr << "read() failed: " << ec.message() << "\n";
+                        return;
+                    }
+
+                    This->requests++;
+                    This->s.expires_never();
+                    This->process_request();
+                });
+        }
+
+        template<typename Body>
+        http::response<Body> make_response(http::status status, std::string_view content_type, typename Body::value_type body)
+        {
+            http::response<Body> response{ status, request.version() };
+            response.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+            response.set(http::field::content_type, content_type);
+            response.keep_alive(request.keep_alive() && requests < PROXY_MAX_REQUESTS_PER_CONNECTION);
+            response.body() = std::move(body);
+            response.prepare_payload();
+            return response;
+        }
+
+        http::response<http::string_body> make_response(http::status status, std::string_view content_type, std::string_view msg)
+        {
+            return make_response<http::string_body>(status, content_type, std::string(msg));
+        }
+
+        void send_response(http::status status, std::string_view content_type, std::string_view msg)
+        {
+            send_response(make_response(status, content_type, msg));
+        }
+
+        // send the response, then wait for the next request, unless the connection is to be closed
+        template<typename Body>
+        void send_response(http::response<Body> &&response)
+        {
+            const bool keep_alive = response.keep_alive();
+            s.expires_after(PROXY_IDLE_TIMEOUT);
+            boost::beast::async_write(s, http::message_generator{ std::move(response) },
+                [This = shared_from_this(), keep_alive](const auto& ec, auto bytes_transferred) {
+                    if (ec)
+                    {
+                        if (ec != boost::asio::error::operation_aborted)
+                            std::cerr << "beast::async_write() failed: " << ec.message() << "\n";
+                        return;
+                    }
+                    if (!keep_alive)
+                        return This->close();
+                    This->start();
+                });
+        }
+
+        void bad_request(std::string_view why)
+        {
+            send_response(http::status::bad_request, "text/plain", why);
+        }
+
+        void not_found()
+        {
+            send_response(http::status::not_found, "text/plain", "not found");
+        }
+
+        static std::string error_html(std::string_view title, std::string_view operation, const boost::system::error_code& ec)
+        {
+            std::ostringstream os;
+            os << "<html><head><title>" << title << "</title></head>"
+                << "<body><h1>" << title << "</h1><p>"
+                << operation;
+            if (ec)
+                os << " failed: " << ec.message();
+            os << "</p></body></html>";
+            return os.str();
+        }
+
+        void error_page(http::status status, std::string_view title, std::string_view operation, const boost::system::error_code& ec)
+        {
+            send_response(status, "text/html", error_html(title, operation, ec));
+        }
+
+        void internal_server_error(std::string_view operation, const boost::system::error_code& ec = {})
+        {
+            error_page(http::status::internal_server_error, "internal server error", operation, ec);
+        }
+
+        // transaction with the PDU failed
+        void transaction_failed(std::string_view operation, const boost::system::error_code& ec)
+        {
+            if (ec == upstream_error::timeout)
+                return error_page(http::status::gateway_timeout, "gateway timeout", operation, ec);
+            if (unavailable(ec))
+            {
+                auto response = make_response(http::status::service_unavailable, "text/html",
+                                              error_html("service unavailable", operation, ec));
+                response.set(http::field::retry_after, std::to_string(retry_after(ec).count()));
+                return send_response(std::move(response));
+            }
+            internal_server_error(operation, ec);
+        }
+
+        // the PDU is not asked at the moment, the client may retry later
+        static bool unavailable(const boost::system::error_code& ec)
+        {
+            return ec == upstream_error::circuit_open || ec == upstream_error::overloaded;
+        }
+
+        std::chrono::seconds retry_after(const boost::system::error_code& ec)
+        {
+            return ec == upstream_error::circuit_open ? upstream().breaker().retry_after() : std::chrono::seconds(1);
+        }
+
+        // clients must revalidate their copy, the switch states change at any time
+        template<typename Body>
+        static void set_validator(http::response<Body> &response, std::string_view etag)
+        {
+            response.set(http::field::etag, etag);
+            response.set(http::field::cache_control, "no-cache");
+        }
+
+        // answer 304 Not Modified without a body, if the client's copy is current
+        bool not_modified(std::string_view etag)
+        {
+            const auto if_none_match = request[http::field::if_none_match];
+            if (!etag_matches({ if_none_match.data(), if_none_match.size() }, etag))
+                return false;
+
+            auto response = make_response<http::empty_body>(http::status::not_modified, {}, {});
+            response.erase(http::field::content_type);
+            response.erase(http::field::content_length);
+            set_validator(response, etag);
+            send_response(std::move(response));
+            return true;
+        }
+
+        void root_document(bool fresh)
+        {
+            async_status_transaction(upstream_context, fresh, boost::asio::bind_executor(s.get_executor(), [This = shared_from_this()](auto ec, const auto &switch_states) {
+                if (ec)
+                    return This->transaction_failed("http-transaction status", ec);
+
+                const auto breaker = This->upstream().breaker().get_state();
+                const auto etag    = root_page::etag(switch_states, breaker);
+                if (This->not_modified(etag))
+                    return;
+
+                auto response = This->make_response<shared_string_body>(http::status::ok, "text/html", root_page::get(switch_states, breaker));
+                set_validator(response, etag);
+                return This->send_response(std::move(response));
+                }));
+        }
+
+        void show(bool fresh)
+        {
+            async_status_transaction(upstream_context, fresh, boost::asio::bind_executor(s.get_executor(), [This = shared_from_this()](auto ec, const auto &switch_states) {
+                if (ec)
+                    return This->transaction_failed("http-transaction status", ec);
+
+                const auto etag = make_etag('s', std::uint32_t(switch_states.reported_mask.to_bits()) << 8 | switch_states.on_mask.to_bits());
+                if (This->not_modified(etag))
+                    return;
+
+                std::ostringstream os;
+                for(const auto &state:switch_states)
+                    os << state.name << ": " << (state.state ? "on"s : "off"s) << "\n";
+
+                auto response = This->make_response(http::status::ok, "text/plain", os.str());
+                set_validator(response, etag);
+                return This->send_response(std::move(response));
+                }));
+        }
+
+        upstream_client& upstream()
+        {
+            return boost::asio::use_service<upstream_client>(upstream_context);
         }
-        session() = delete;
-        session(const session&) = delete;
-        session& operator=(const session&) = delete;
 
-        void close()
+        // the statistics belong to the upstream strand
+        void metrics()
         {
-            boost::system::error_code e;
-            s.socket().shutdown(tcp::socket::shutdown_send, e);
-            s.socket().close(e);
+            boost::asio::dispatch(upstream().executor(), [This = shared_from_this()]() {
+                std::ostringstream os;
+                This->upstream().write_metrics(os);
+                boost::asio::use_service<status_fetcher>(This->upstream_context).write_metrics(os);
+                boost::asio::use_service<switch_reconciler>(This->upstream_context).write_metrics(os);
+                admission_control::instance().write_metrics(os);
+                boost::asio::dispatch(This->s.get_executor(), [This, text = os.str()]() {
+                    This->send_response(http::status::ok, "text/plain", text);
+                });
+            });
         }
 
-        void start()
+        // the switch states, like GET /api/v1
+        static std::string state_event(const channel_states &switch_states)
         {
-            request = {};
-            boost::beast::http::async_read(s, buffer, request,
-                [This = shared_from_this()](auto ec, auto bytes_transferred) {
-                    if (ec)
-                    {
-                        if (ec == http::error::end_of_stream)
-                            This->close();
-                        else if (ec != boost::asio::error::operation_aborted)
-                            std::cerr << "read() failed: " << ec.message() << "\n";
-                        return;
-                    }
+            return "data: " + boost::json::serialize(api_states(switch_states)) + "\n\n";
+        }
 
-                    This->process_request();
-                });
+        static std::string breaker_event(circuit_breaker::state_t breaker)
+        {
+            return "event: breaker\ndata: " + boost::json::serialize(boost::json::string(circuit_breaker::name(breaker))) + "\n\n";
         }
 
-        void send_response(http::status status, std::string_view content_type, std::string_view msg)
+        // Server-Sent Events: the switch states, then every change of them.
+        // All streams are fed by the status_fetcher poller, no matter how many are open.
+        void events()
         {
-            http::response<http::string_body> response{ status, request.version() };
+            http::response<http::empty_body> response{ http::status::ok, request.version() };
             response.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-            response.set(http::field::content_type, content_type);
-            response.body() = std::string(msg);
-            response.prepare_payload();
+            response.set(http::field::content_type, "text/event-stream");
+            response.set(http::field::cache_control, "no-cache");
+            response.keep_alive(false);
 
-            boost::beast::async_write(s, http::message_generator{ std::move(response) },
-                [This = shared_from_this()](const auto& ec, auto bytes_transferred) {
-                    if (ec)
-                    {
-                        if (ec != boost::asio::error::operation_aborted)
-                            std::cerr << "beast::async_write() failed: " << ec.message() << "\n";
-                        return;
-                    }
-                    This->close();
+            std::ostringstream os;
+            os << response.base();
+            streaming = true;
+            s.expires_never();
+            // reading first, the timeouts of the writes do not apply to a pending read
+            wait_for_close();
+            send_event(os.str());
+
+            boost::asio::dispatch(upstream().executor(), [This = shared_from_this()]() {
+                boost::asio::use_service<status_fetcher>(This->upstream_context).subscribe(This.get(), [This](const auto &switch_states) {
+                    boost::asio::dispatch(This->s.get_executor(), [This, event = state_event(switch_states)]() {
+                        This->send_event(event);
+                    });
+                }, [This](auto breaker) {
+                    boost::asio::dispatch(This->s.get_executor(), [This, event = breaker_event(breaker)]() {
+                        This->send_event(event, true);
+                    });
                 });
+            });
+            heartbeat();
         }
 
-        void bad_request(std::string_view why)
+        // While an event is written, only the latest of the following ones is
+        // kept, of the switch states and of the breaker state each.
+        // A client, that stays connected but does not read, is dropped after a
+        // write took longer than two heartbeats.
+        void send_event(std::string event, bool breaker = false)
         {
-            send_response(http::status::bad_request, "text/plain", why);
+            if (!streaming)
+                return;
+            if (writing)
+            {
+                (breaker ? next_breaker_event : next_event) = std::move(event);
+                return;
+            }
+
+            writing  = true;
+            outgoing = std::move(event);
+            s.expires_after(2 * EVENTS_HEARTBEAT);
+            boost::asio::async_write(s, boost::asio::buffer(outgoing), [This = shared_from_this()](auto ec, auto bytes_transferred) {
+                This->writing = false;
+                if (ec)
+                    return This->stop_events();
+                if (!This->next_event.empty())
+                    This->send_event(std::exchange(This->next_event, {}));
+                else if (!This->next_breaker_event.empty())
+                    This->send_event(std::exchange(This->next_breaker_event, {}), true);
+            });
         }
 
-        void not_found()
+        // the client does not send anything, a completed read means it went away
+        void wait_for_close()
         {
-            send_response(http::status::not_found, "text/plain", "not found");
+            s.async_read_some(buffer.prepare(512), [This = shared_from_this()](auto ec, auto bytes_transferred) {
+                if (ec)
+                    return This->stop_events();
+                This->wait_for_close();
+            });
         }
 
-        void internal_server_error(std::string_view operation, const boost::system::error_code& ec = {})
+        // keep idle streams open through proxies and detect dead clients
+        void heartbeat()
         {
-            std::ostringstream os;
-            os << "<html><head><title>internal server error</title></head>"
-                << "<body><h1>internal server error</h1><p>"
-                << operation;
-            if (ec)
-                os << " failed: " << ec.message();
-            os << "</p></body></html>";
-            send_response(http::status::internal_server_error, "text/html", os.str());
+            timer.expires_from_now(boost::posix_time::milliseconds(std::chrono::duration_cast<std::chrono::milliseconds>(EVENTS_HEARTBEAT).count()));
+            timer.async_wait([This = shared_from_this()](auto ec) {
+                if (ec || !This->streaming)
+                    return;
+                if (!This->writing)
+                    This->send_event(": heartbeat\n\n");
+                This->heartbeat();
+            });
         }
 
-        void root_document()
+        void stop_events()
         {
-            async_http_transaction(io_context, status_request(), [This = shared_from_this()](auto ec, auto response) {
-                if (ec)
-                    return This->internal_server_error("http-transaction status", ec);
+            if (!streaming)
+                return;
+            streaming = false;
+            timer.cancel();
+            boost::asio::dispatch(upstream().executor(), [This = shared_from_this()]() {
+                boost::asio::use_service<status_fetcher>(This->upstream_context).unsubscribe(This.get());
+            });
+            close();
+        }
 
-                try
-                {
-                    auto switch_states = parse_status_response(response);
-                    std::ostringstream os;
-                    os << R"---(
-<html>
-    <head>
-        <title>power switch</title>
-        <meta name="viewport" content="width=device-width, initial-scale=1.0">
-        <style>
-.on {
-  background-color: Chartreuse;
-}
-.off {
-}
-.state {
-  text-align: center;
-}
-table, th, td {
-  border: 1px solid;
-  border-collapse: collapse;
-}
-#overlay.dim {
-  display:inline;
-}
+        void api_response(http::status status, const boost::json::value &body)
+        {
+            send_response(status, "application/json", boost::json::serialize(body));
+        }
 
-#overlay {
-  background-color: rgba(0,0,0,0.2);
-  display:none;
-  position:fixed;
-  left:0;
-  top: 0;
-  width:100%;
-  height:100%;
-}
-        </style>
-        <script>
+        // failed request to the PDU, status codes as by transaction_failed()
+        void api_failed(const boost::system::error_code& ec)
+        {
+            const boost::json::object body{{"error", ec.message()}};
+            if (ec == upstream_error::timeout)
+                return api_response(http::status::gateway_timeout, body);
+            if (unavailable(ec))
+            {
+                auto response = make_response(http::status::service_unavailable, "application/json", boost::json::serialize(body));
+                response.set(http::field::retry_after, std::to_string(retry_after(ec).count()));
+                return send_response(std::move(response));
+            }
+            api_response(http::status::internal_server_error, body);
+        }
 
-function set_switch(request)
-{
-  // din window when operation is in progress
-  document.getElementById('overlay').classList.add('dim');
+        static boost::json::object api_states(const channel_states &switch_states)
+        {
+            boost::json::object states;
+            for(const auto &state:switch_states)
+                states[state.name] = state.state ? "on" : "off";
+            return states;
+        }
 
-  const xhr = new XMLHttpRequest();
-  xhr.open("GET", "/" + request, true);
-  xhr.onload = (e) => {
-    if (xhr.readyState === 4) {
-      if (xhr.status === 200) {
-//        console.log(xhr.responseText);
-      } else {
-        console.error(xhr.statusText);
-      }
-      location.reload();
-    }
-  };
-  xhr.onerror = (e) => {
-    console.error(xhr.statusText);
-    location.reload();
-  };
-  xhr.send(null);
-}
+        // GET: the switch states, POST: run a batch of operations, see api_batch
+        void api(std::string_view path)
+        {
+            if (path != "v1")
+                return not_found();
 
-        </script>
-    </head>
-    <body>
-        <h1>power switch</h1>
+            if (request.method() == http::verb::get)
+            {
+                if (throttled(request_class::read))
+                    return;
+                return async_status_transaction(upstream_context, false, boost::asio::bind_executor(s.get_executor(), [This = shared_from_this()](auto ec, const auto &switch_states) {
+                    if (ec)
+                        return This->api_failed(ec);
+                    This->api_response(http::status::ok, {{"state", api_states(switch_states)}});
+                    }));
+            }
 
-        <h2>Scenes:</h2>
-        <ul>
-)---";
-                    for (const auto &scene: scenes)
-                        os << "<li><button onclick='set_switch(\"set/" << scene.first <<"\")'>" << scene.first << "</button></li>\n";
-                    os << R"---(
-        </ul>
+            if (request.method() != http::verb::post)
+                return method_not_allowed("GET, POST");
 
-        <h2>Channels:</h2>
-        <table>
-            <tr><th>channel</th><th>state</th><th colspan='2'>command</th></tr>
-)---";
-                    for(const auto &state:switch_states)
-                    {
-                        os << "<tr class='" << state.name << "'>";
-                        os << "<td class='channel'>" << state.name << "</td>";
-                        os << "<td class='state " << (state.state ? "on" : "off") << "'>" << (state.state ? "on" : "off") << "</td>";
-                        
-                        os << "<td class='off_button'><button onclick='set_switch(\"" << state.name <<"?off\")'>off</button></td>";
-                        os << "<td class='on_button'><button onclick='set_switch(\"" << state.name <<"?on\")'>on</button></td>";
-                        
-                        os << "</tr>\n";
-                    }
-                    os << R"---(
-            <tr>
-                <td>all</td>
-                <td/>
-                <td class='off_button'><button onclick='set_switch("all?off")'>off</button></td>
-                <td class='on_button' >
-                    <!-- <button onclick='set_switch("all?on")' >on</button> -->
-                </td>
-            </tr>
-        </table>
+            auto batch = std::make_shared<api_batch>();
+            std::string error;
+            if (!parse_api_batch(request.body(), *batch, error))
+                return api_response(http::status::bad_request, {{"error", error}});
+            if (throttled(batch->stages.size() > 1 ? request_class::cycle : request_class::write))
+                return;
+            run_api_stage(batch, 0);
+        }
 
-        <div id='overlay'/>
+        void run_api_stage(std::shared_ptr<api_batch> batch, std::size_t n)
+        {
+            if (n == batch->stages.size())
+                return api_results(batch, batch->stages.size(), {});
 
-    </body>
-</html>
-)---";
+            auto steps = batch->stages[n].steps();
+            const auto next = [This = shared_from_this(), batch, n](auto ec) {
+                if (ec)
+                    return This->api_results(batch, n, ec);
+                if (batch->stages[n].wait.count() == 0)
+                    return This->run_api_stage(batch, n + 1);
+
+                const auto resume = std::chrono::steady_clock::now() + batch->stages[n].wait;
+                This->timer.expires_from_now(boost::posix_time::milliseconds(batch->stages[n].wait.count()));
+                This->watch_for_close();
+                This->timer.async_wait([This, batch, n, resume](auto ec) {
+                    // The client went away. The next stage turns the channels of the
+                    // power cycle on again, it runs anyway, later ones are not run.
+                    This->watching = false;
+                    if (!This->s.socket().is_open())
+                        return switch_at(This->upstream_context, batch->stages[n + 1].steps(), batch->stages[n + 1].isolated, resume);
+                    boost::system::error_code e;
+                    This->s.socket().cancel(e);
 
-                    return This->send_response(http::status::ok, "text/html", os.str());
-                }
-                catch (const std::exception& ex)
-                {
-                    return This->internal_server_error("xml parsing failed: "s + ex.what(), ec);
-                }
+                    if (ec)
+                        return This->api_results(batch, n, ec);
+                    This->run_api_stage(batch, n + 1);
                 });
+            };
+            if (steps.empty())
+                return next(boost::system::error_code{});
+            async_switch_transaction(upstream_context, std::move(steps), batch->stages[n].isolated,
+                boost::asio::bind_executor(s.get_executor(), next));
         }
 
-        void show()
+        // While a batch waits, the client sends nothing but pipelined requests,
+        // which are kept in buffer, up to max_pipelined bytes. A failed read
+        // means it went away, then the connection is closed and the wait
+        // cancelled, see run_api_stage(). Once the buffer is full, reading
+        // stops, a client going away is then noticed when writing the response.
+        void watch_for_close()
         {
-            async_http_transaction(io_context, status_request(), [This = shared_from_this()](auto ec, auto response) {
+            watching = true;
+            if (buffer.size() >= max_pipelined)
+                return;
+            s.async_read_some(buffer.prepare(std::min<std::size_t>(512, max_pipelined - buffer.size())), [This = shared_from_this()](auto ec, auto bytes_transferred) {
+                if (ec == boost::asio::error::operation_aborted)
+                    return;
                 if (ec)
-                    return This->internal_server_error("http-transaction status", ec);
-
-                try
                 {
-                    auto switch_states = parse_status_response(response);
-                    std::ostringstream os;
-                    for(const auto &state:switch_states)
-                        os << state.name << ": " << (state.state ? "on"s : "off"s) << "\n";
-
-                    return This->send_response(http::status::ok, "text/plain", os.str());
+                    This->close();
+                    This->timer.cancel();
+                    return;
                 }
-                catch (const std::exception& ex)
+                This->buffer.commit(bytes_transferred);
+                if (This->watching)
+                    This->watch_for_close();
+            });
+        }
+
+        // Stages before failed_stage succeeded, later ones have not been run.
+        void api_results(std::shared_ptr<api_batch> batch, std::size_t failed_stage, boost::system::error_code error)
+        {
+            boost::json::array results;
+            for (const auto &operation:batch->operations)
+            {
+                boost::json::object result{{"op", operation.op}};
+                if (operation.last_stage < failed_stage)
+                    result["result"] = "ok";
+                else if (operation.first_stage <= failed_stage)
                 {
-                    return This->internal_server_error("xml parsing failed: "s + ex.what(), ec);
+                    result["result"] = "error";
+                    result["error"]  = error.message();
                 }
-                });
+                else
+                    result["result"] = "skipped";
+                results.push_back(std::move(result));
+            }
+
+            async_status_transaction(upstream_context, false, boost::asio::bind_executor(s.get_executor(),
+                [This = shared_from_this(), results = std::move(results)](auto ec, const auto &switch_states) {
+                    This->api_response(http::status::ok, {
+                        {"results", results},
+                        {"state",   ec ? boost::json::value{} : boost::json::value(api_states(switch_states))},
+                    });
+                }));
         }
 
-        void power_cycle(const std::set<channel>& channels, std::chrono::milliseconds delay)
+        // answer 429, if the client has no token left for a request of this class
+        bool throttled(request_class cls)
         {
-            async_http_transaction(io_context, swith_request(channels, off),
-                [This = shared_from_this(), channels, delay](auto ec, auto response) {
+            const auto retry_after = admission_control::instance().throttle(ticket.client(), cls);
+            if (!retry_after)
+                return false;
+
+            auto response = make_response(http::status::too_many_requests, "text/plain", "too many requests");
+            response.set(http::field::retry_after, std::to_string(retry_after->count()));
+            send_response(std::move(response));
+            return true;
+        }
+
+        // GET: the admission limits, POST: change them, only from the local host
+        void limits()
+        {
+            auto &control = admission_control::instance();
+            if (request.method() == http::verb::get)
+                return send_response(http::status::ok, "application/json", to_json(control.get_limits()));
+            if (request.method() != http::verb::post)
+                return method_not_allowed("GET, POST");
+            if (!ticket.client().is_loopback())
+                return api_response(http::status::forbidden, {{"error", "limits may only be changed from the local host"}});
+
+            auto limits = control.get_limits();
+            std::string error;
+            if (!parse_admission_limits(request.body(), limits, error))
+                return api_response(http::status::bad_request, {{"error", error}});
+            control.set_limits(limits);
+            send_response(http::status::ok, "application/json", to_json(limits));
+        }
+
+        void method_not_allowed(std::string_view allow)
+        {
+            auto response = make_response(http::status::method_not_allowed, "text/plain", "method not allowed");
+            response.set(http::field::allow, allow);
+            send_response(std::move(response));
+        }
+
+        // hand the connection over to a command channel
+        void upgrade()
+        {
+            if (!boost::beast::websocket::is_upgrade(request))
+                return send_response(http::status::upgrade_required, "text/plain", "websocket upgrade required");
+            std::make_shared<ws_session>(upstream_context, std::move(s), std::move(ticket))->run(std::move(request));
+        }
+
+        void power_cycle(channel_mask channels, std::chrono::milliseconds delay)
+        {
+            // both steps are isolated, so neither is merged away by other commands
+            async_switch_transaction(upstream_context, {{channels, off}}, true, boost::asio::bind_executor(s.get_executor(),
+                [This = shared_from_this(), channels, delay](auto ec) {
                     if (ec)
-                        return This->internal_server_error("http-transaction off", ec);
+                        return This->transaction_failed("http-transaction off", ec);
 
                     This->timer.expires_from_now(boost::posix_time::milliseconds(delay.count()));
                     This->timer.async_wait([This, channels](auto ec) {
                         if (ec)
                             return This->internal_server_error("wait", ec);
 
-                        async_http_transaction(This->io_context, swith_request(channels, on),
-                            [This, channels](auto ec, auto response) {
+                        async_switch_transaction(This->upstream_context, {{channels, on}}, true, boost::asio::bind_executor(This->s.get_executor(),
+                            [This, channels](auto ec) {
                                 if (ec)
-                                    return This->internal_server_error("http-transaction on", ec);
+                                    return This->transaction_failed("http-transaction on", ec);
 
                                 This->send_response(http::status::ok, "text/plain", to_string(channels) + ": power cycled");
-                            });
+                            }));
                         });
-                });
+                }));
         }
 
-        void set_channels(const std::set<channel>& channels, op_t op)
+        void set_channels(channel_mask channels, op_t op)
         {
-            async_http_transaction(io_context, swith_request(channels, op),
-                [This = shared_from_this(), channels, op](auto ec, auto response) {
+            async_switch_transaction(upstream_context, channels, op, boost::asio::bind_executor(s.get_executor(),
+                [This = shared_from_this(), channels, op](auto ec) {
                     if (ec)
-                        return This->internal_server_error("http-transaction", ec);
+                        return This->transaction_failed("http-transaction", ec);
                     return This->send_response(http::status::ok, "text/plain", to_string(channels) + ": " + to_string(op));
-                });
+                }));
         }
 
-        void set_channels(const std::set<channel>& channels, std::string_view query)
+        void set_channels(channel_mask channels, std::string_view query)
         {
-            if (iequals(query, "on"))
-                set_channels(channels, on);
-            else if (iequals(query, "off"))
-                set_channels(channels, off);
-            else if (iequals(query, "cycle"))
-                power_cycle(channels, std::chrono::seconds(5));
-            else
+            const auto command = command_table.find(query);
+            if (!command)
                 return bad_request("request error: illegal request");
+
+            switch (*command)
+            {
+                case command_t::on:    return set_channels(channels, on);
+                case command_t::off:   return set_channels(channels, off);
+                case command_t::cycle: return power_cycle(channels, power_cycle_duration);
+            }
         }
 
         void set_scene(std::string_view name)
         {
-            auto it = scenes.find(name);
-            if (it == scenes.end())
+            const auto scene = find_scene(name);
+            if (!scene)
                 return not_found();
-            const auto& scene = it->second;
 
-            auto turn_on = [This = shared_from_this(), &scene]() {
-                if (scene.on.empty())
-                    return This->send_response(http::status::ok, "text/plain", "Ok");
-                async_http_transaction(This->io_context, swith_request(scene.on, on), [This](auto ec, auto& response) {
+            async_switch_transaction(upstream_context, {{scene->off, off}, {scene->on, on}}, boost::asio::bind_executor(s.get_executor(),
+                [This = shared_from_this()](auto ec) {
                     if (ec)
-                        return This->internal_server_error("http-transaction on", ec);
+                        return This->transaction_failed("http-transaction", ec);
                     This->send_response(http::status::ok, "text/plain", "Ok");
-                    });
-                };
-
-            if (scene.off.empty())
-                return turn_on();
-
-            async_http_transaction(io_context, swith_request(scene.off, off),
-                [This = shared_from_this(), turn_on = std::move(turn_on)](auto ec, auto& response) {
-                    if (ec)
-                        return This->internal_server_error("http-transaction off", ec);
-                    turn_on();
-                });
+                }));
         }
 
         void process_request()
         {
-            if (request.method() != http::verb::get)
-            {
-                //todo
-                std::cerr << "bad method\n";
-                return;
-            }
-
             const std::string_view target{ request.target().data(), request.target().size() };
             auto n = request.target().find('?');
             auto query = n == std::string::npos ? "" : request.target().substr(n + 1);
@@ -742,47 +3799,93 @@ function set_switch(request)
                 return bad_request("request error: path is not absolute");
             path = path.substr(1); // strip off leading '/';
 
+            const bool fresh = iequals(query, "fresh=1");
             if (path == "")
-                return root_document();
-            else if (iequals(path, "show"))
-                return show();
-            else if (iequals(path, "all"))
-                return set_channels(all_channels(), query);
-
-            auto it = map_channel_name_to_index.find(path);
-            if (it != map_channel_name_to_index.end())
-                return set_channels({ it->second }, query);
+            {
+                if (request.method() != http::verb::get)
+                    return method_not_allowed("GET");
+                if (throttled(request_class::read))
+                    return;
+                return root_document(fresh);
+            }
 
-            auto root = strip_path_element(path);
-            if (iequals(root, "set"))
-                return set_scene(path);
+            const auto route = route_table.find(strip_path_element(path));
+            if (!route || (route->type != route_t::set && route->type != route_t::api && !path.empty()))
+                return not_found();
+            if (route->type != route_t::api && route->type != route_t::limits && request.method() != http::verb::get)
+                return method_not_allowed("GET");
+
+            // /api classifies its requests itself, after parsing them
+            auto cls = request_class::read;
+            if (route->type == route_t::set || (route->type == route_t::limits && request.method() != http::verb::get))
+                cls = request_class::write;
+            else if (route->type == route_t::all || route->type == route_t::channel)
+            {
+                const auto command = command_table.find(query);
+                cls = command && *command == command_t::cycle ? request_class::cycle : request_class::write;
+            }
+            if (route->type != route_t::api && throttled(cls))
+                return;
 
-            return not_found();
+            switch (route->type)
+            {
+                case route_t::show:    return show(fresh);
+                case route_t::metrics: return metrics();
+                case route_t::events:  return events();
+                case route_t::ws:      return upgrade();
+                case route_t::api:     return api(path);
+                case route_t::limits:  return limits();
+                case route_t::all:     return set_channels(all_channels(), query);
+                case route_t::channel: return set_channels({ route->ch }, query);
+                case route_t::set:     return set_scene(path);
+            }
         }
 
     };
 
     boost::asio::io_context &io_context;
+    boost::asio::io_context &upstream_context;
     tcp::acceptor acceptor{ io_context };
 
     void accept()
     {
-        acceptor.async_accept([this](auto ec, auto&& socket) {
+        acceptor.async_accept(boost::asio::make_strand(io_context), [this](auto ec, auto&& socket) {
             if (ec)
             {
                 if (ec != boost::asio::error::operation_aborted)
                     std::cerr << "accept() failed: " << ec.message() << "\n";
                 return;
             }
-            std::make_shared<session>(io_context, std::move(socket))->start();
+            boost::system::error_code e;
+            auto client = socket.remote_endpoint(e).address();
+            if (client.is_v6() && client.to_v6().is_v4_mapped())
+                client = boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, client.to_v6());
+
+            auto ticket = admission_control::instance().admit(client);
+            if (e || !ticket)
+                socket.close(e);
+            else
+            {
+                // sessions are allocated from a per-thread cache, with sharding that is a per-shard cache
+                std::allocate_shared<session>(boost::asio::recycling_allocator<session>(), upstream_context, std::move(socket), std::move(*ticket))->start();
+            }
             accept();
         });
     }
 
 public:
-    proxy_server(boost::asio::io_context &io_context):io_context{ io_context }{}
+    proxy_server(boost::asio::io_context &io_context):io_context{ io_context }, upstream_context{ io_context }{}
+
+    // A shard of a proxy, sessions are served by io_context, upstream requests
+    // are forwarded to the upstream services of upstream_context.
+    proxy_server(boost::asio::io_context &io_context, boost::asio::io_context &upstream_context):
+        io_context{ io_context },
+        upstream_context{ upstream_context }
+    {
+    }
 
-    int start()
+    // reuse_port: several shards listen on the same port, the kernel distributes connections
+    int start(bool reuse_port = false)
     {
         tcp::endpoint ep{
 #ifdef PROXY_BIND_ADDR
@@ -811,6 +3914,24 @@ public:
         if (ec)
             std::cerr << "set_option(reuse_address, true) failed: " << ec.message() << "\n";
 
+#ifdef SO_REUSEPORT
+        if (reuse_port)
+        {
+            acceptor.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>{ true }, ec);
+            if (ec)
+            {
+                std::cerr << "set_option(reuse_port, true) failed: " << ec.message() << "\n";
+                return -1;
+            }
+        }
+#else
+        if (reuse_port)
+        {
+            std::cerr << "SO_REUSEPORT is not supported on this platform\n";
+            return -1;
+        }
+#endif
+
         acceptor.bind(ep, ec);
         if (ec)
         {
@@ -826,6 +3947,15 @@ public:
             return -1;
         }
 
+        request_table::instance();
+        if (&upstream_context == &io_context)
+        {
+            auto &upstream = boost::asio::use_service<upstream_client>(upstream_context);
+            upstream.prewarm();
+            boost::asio::dispatch(upstream.executor(), [this]() {
+                boost::asio::use_service<status_fetcher>(upstream_context).start();
+            });
+        }
         accept();
         return 0;
     }
@@ -838,9 +3968,34 @@ public:
 
 };
 
+// Shard-per-core proxy: every shard has its own io_context, thread and
+// acceptor, all bound to the same port with SO_REUSEPORT. Shard 0 owns the
+// upstream services, the other shards post their upstream requests to it.
+static int run_proxy_shards(int shards)
+{
+    std::vector<std::unique_ptr<boost::asio::io_context>> contexts;
+    std::vector<std::unique_ptr<proxy_server>>            proxies;
+    for (int i = 0; i < shards; i++)
+    {
+        contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+        proxies.push_back(std::make_unique<proxy_server>(*contexts.back(), *contexts.front()));
+        auto ret = proxies.back()->start(true);
+        if (ret)
+            return ret;
+    }
+
+    std::vector<std::thread> pool;
+    for (int i = 1; i < shards; i++)
+        pool.emplace_back([&io_context = *contexts[i]]() { io_context.run(); });
+    contexts.front()->run();
+    for (auto &thread:pool)
+        thread.join();
+    return 0;
+}
+
 #endif /* PROXY_PORT */
 
-int set_switch(const std::set<channel> &channels, op_t op)
+int set_switch(channel_mask channels, op_t op)
 {
     boost::system::error_code ec;
     auto response = http_transaction(swith_request(channels, op), ec);
@@ -853,27 +4008,37 @@ int set_switch(const std::set<channel> &channels, op_t op)
     return 0;
 }
 
+// all scenes are switched with one pipelined sequence of requests
 int set_scene(int argc, const char *argv[])
 {
+    std::vector<upstream_request> requests;
     for (int i=0; i<argc; i++)
     {
-        auto scene = argv[i];
-        auto it = scenes.find(scene);
-        if (it == scenes.end())
+        const auto scene = find_scene(argv[i]);
+        if (!scene)
         {
-            std::cerr << "unknown scene: " << scene << "\n";
+            std::cerr << "unknown scene: " << argv[i] << "\n";
             return -1;
         }
-        int ret;
-        if (!it->second.off.empty() && (ret=set_switch(it->second.off, off)))
-                return ret;
-        if (!it->second.on.empty() && (ret=set_switch(it->second.on, on)))
-            return ret;
+        if (!scene->off.empty())
+            requests.push_back(swith_request(scene->off, off));
+        if (!scene->on.empty())
+            requests.push_back(swith_request(scene->on, on));
+    }
+    if (requests.empty())
+        return 0;
+
+    boost::system::error_code ec;
+    http_pipeline(std::move(requests), ec);
+    if (ec)
+    {
+        std::cerr << "GET /control_outlet.htm failed: " << ec.message() << "\n";
+        return -1;
     }
     return 0;
 }
 
-int show(const std::set<channel> &channels)
+int show(channel_mask channels)
 {
     boost::system::error_code ec;
     auto response = http_transaction(status_request(), ec);
@@ -899,7 +4064,7 @@ int show(const std::set<channel> &channels)
 int show_channels()
 {
     std::cout << "Available channels:\n";
-    for (const auto &item:map_channel_name_to_index)
+    for (const auto &item:channel_names)
         std::cout << "- " << item.first << "\n";
     std::cout << "- all\n";
     return 0;
@@ -985,6 +4150,8 @@ int usage(const char* name)
 #else
     std::cerr << "    " << name << " proxy               : proxy server on port " << PROXY_BIND_PORT << "\n";
 #endif
+    std::cerr << "    " << name << " proxy --threads <n> : proxy server on <n> threads\n";
+    std::cerr << "    " << name << " proxy --shards <n>  : proxy server on <n> threads, each with its own listening socket\n";
 #ifdef _WIN32
     PowerSwitchService{}.handle_command("", std::string{ name } + " service");
 #endif /* _WIN32 */
@@ -1028,7 +4195,7 @@ int main(int argc, const char * argv[])
         auto ret = set_switch(channels, off);
         if (ret)
             return ret;
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+        std::this_thread::sleep_for(power_cycle_duration);
         return set_switch(channels, on);
     }
     else if (iequals(cmd, "set"))
@@ -1046,15 +4213,32 @@ int main(int argc, const char * argv[])
 #ifdef PROXY_BIND_PORT
     else if (iequals(cmd, "proxy"))
     {
-        if (argc!=2)
+        int threads = 1;
+        int shards  = 0;
+        if (argc == 4 && iequals(argv[2], "--threads"))
+            threads = std::atoi(argv[3]);
+        else if (argc == 4 && iequals(argv[2], "--shards"))
+            shards = std::atoi(argv[3]);
+        else if (argc != 2)
+            return usage(argv[0]);
+        if (threads < 1 || shards < 0)
             return usage(argv[0]);
 
-        boost::asio::io_context io_context;
+        if (shards)
+            return run_proxy_shards(shards);
+
+        boost::asio::io_context io_context{ threads };
         proxy_server proxy{ io_context };
         auto ret = proxy.start();
         if (ret)
             return ret;
+
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; i++)
+            pool.emplace_back([&io_context]() { io_context.run(); });
         io_context.run();
+        for (auto &thread:pool)
+            thread.join();
         return 0;
     }
 #endif /* PROXY_PORT */
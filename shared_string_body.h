@@ -0,0 +1,70 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARED_STRING_BODY_H_
+#define SHARED_STRING_BODY_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <boost/system/error_code.hpp>
+
+// Beast body of an immutable, shared string. Responses with the same
+// content share one buffer, sending them neither formats nor copies.
+struct shared_string_body
+{
+    using value_type = std::shared_ptr<const std::string>;
+
+    static std::uint64_t size(const value_type &body)
+    {
+        return body ? body->size() : 0;
+    }
+
+    class writer
+    {
+        const value_type &body;
+
+    public:
+        using const_buffers_type = boost::asio::const_buffer;
+
+        template<bool isRequest, class Fields>
+        explicit writer(const boost::beast::http::header<isRequest, Fields>&, const value_type &body):
+            body{body}
+        {
+        }
+
+        void init(boost::system::error_code &ec)
+        {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(boost::system::error_code &ec)
+        {
+            ec = {};
+            if (!body)
+                return boost::none;
+            return {{ boost::asio::buffer(*body), false }};
+        }
+    };
+};
+
+#endif /* SHARED_STRING_BODY_H_ */
@@ -0,0 +1,101 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATUS_BODY_H_
+#define STATUS_BODY_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/buffers_range.hpp>
+#include <boost/beast/core/detail/clamp.hpp>
+#include <boost/beast/http/error.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <boost/system/error_code.hpp>
+
+#include "status_scanner.h"
+
+// Beast body of a response from the PDU. The data is kept as a string, for
+// the full XML parser, and fed to a status_scanner while it is read, so a
+// status.xml has been scanned when the response is complete. Other
+// responses just fail the scan after a few characters.
+struct status_body
+{
+    struct value_type
+    {
+        std::string    text;
+        status_scanner scanner;
+    };
+
+    static std::uint64_t size(const value_type &body)
+    {
+        return body.text.size();
+    }
+
+    class reader
+    {
+        value_type &body;
+
+    public:
+        template<bool isRequest, class Fields>
+        explicit reader(boost::beast::http::header<isRequest, Fields>&, value_type &body):
+            body{body}
+        {
+        }
+
+        void init(const boost::optional<std::uint64_t> &length, boost::system::error_code &ec)
+        {
+            body.text.clear();
+            body.scanner = {};
+            if (length)
+            {
+                if (*length > body.text.max_size())
+                {
+                    ec = boost::beast::http::error::buffer_overflow;
+                    return;
+                }
+                body.text.reserve(boost::beast::detail::clamp(*length));
+            }
+            ec = {};
+        }
+
+        template<class ConstBufferSequence>
+        std::size_t put(const ConstBufferSequence &buffers, boost::system::error_code &ec)
+        {
+            std::size_t size = 0;
+            for (const auto b:boost::beast::buffers_range_ref(buffers))
+            {
+                const std::string_view chunk{static_cast<const char*>(b.data()), b.size()};
+                body.text += chunk;
+                body.scanner.feed(chunk);
+                size += b.size();
+            }
+            ec = {};
+            return size;
+        }
+
+        void finish(boost::system::error_code &ec)
+        {
+            ec = {};
+        }
+    };
+};
+
+#endif /* STATUS_BODY_H_ */
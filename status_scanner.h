@@ -0,0 +1,315 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATUS_SCANNER_H_
+#define STATUS_SCANNER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Incremental scanner for the PDU's status.xml:
+//   <response><outletStat0>on</outletStat0>...<outletStat7>off</outletStat7>...</response>
+// It collects the outletStatN values (children of the root element) into bit
+// masks, without building a DOM and without allocating. Data can be fed in
+// chunks as it arrives. Anything unusual (comments, CDATA, entities,
+// attributes or empty outletStatN elements, ...) fails the scan, so that the
+// caller can fall back to a full XML parser.
+class status_scanner
+{
+    enum class state_t
+    {
+        text,       // character data outside of outletStatN
+        tag,        // after '<', collecting the element name
+        attributes, // rest of a tag, up to '>'
+        quoted,     // attribute value
+        value,      // content of outletStatN
+        value_end,  // after '<' terminating the content of outletStatN
+        complete,   // root element has been closed
+        failed,
+    };
+
+    static constexpr std::string_view prefix = "outletStat";
+
+    state_t      state   = state_t::text;
+    char         name[prefix.size() + 2];   // one more than "outletStatN", to detect longer names
+    std::size_t  name_len = 0;
+    bool         closing  = false;          // </...>
+    bool         declaration = false;       // <?...?>
+    bool         slash    = false;          // last character in a tag was '/'
+    char         quote    = 0;
+    unsigned     depth    = 0;
+    int          channel  = -1;             // outletStatN being read
+    char         content[3];
+    std::size_t  content_len = 0;
+    std::uint8_t reported_mask = 0;
+    std::uint8_t on_mask       = 0;
+
+    static bool space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+    // channel number, if the collected name is outletStat0 .. outletStat7
+    int outlet() const
+    {
+        if (name_len != prefix.size() + 1 || std::memcmp(name, prefix.data(), prefix.size()) != 0)
+            return -1;
+        const char digit = name[prefix.size()];
+        return digit >= '0' && digit <= '7' ? digit - '0' : -1;
+    }
+
+    void open_element()
+    {
+        depth++;
+    }
+
+    void close_element()
+    {
+        if (depth == 0)
+        {
+            state = state_t::failed;
+            return;
+        }
+        if (--depth == 0)
+            state = state_t::complete;
+    }
+
+    // '>' or end of the element name
+    void end_of_name(char c)
+    {
+        if (name_len == 0)
+        {
+            state = state_t::failed;
+            return;
+        }
+
+        const int ch = closing ? -1 : outlet();
+        if (ch >= 0)
+        {
+            // outletStatN with attributes or empty, or not a child of the root element
+            if (c != '>' || depth != 1)
+            {
+                state = state_t::failed;
+                return;
+            }
+            depth++;
+            channel     = ch;
+            content_len = 0;
+            state       = state_t::value;
+            return;
+        }
+
+        if (c != '>')
+        {
+            slash = c == '/';
+            state = state_t::attributes;
+            return;
+        }
+
+        state = state_t::text;
+        if (closing)
+            close_element();
+        else
+            open_element();
+    }
+
+    void end_of_value()
+    {
+        const std::uint8_t bit = 1 << channel;
+        if (!(reported_mask & bit))         // the first one counts
+        {
+            reported_mask |= bit;
+            if (content_len == 2 && (content[0] | 0x20) == 'o' && (content[1] | 0x20) == 'n')
+                on_mask |= bit;
+        }
+        state = state_t::value_end;
+    }
+
+    void step(char c)
+    {
+        switch (state)
+        {
+            case state_t::text:
+                if (c == '<')
+                {
+                    state       = state_t::tag;
+                    name_len    = 0;
+                    closing     = false;
+                    declaration = false;
+                }
+                else if (c == '&' || (depth == 0 && !space(c)))
+                    state = state_t::failed;
+                break;
+
+            case state_t::tag:
+                if (name_len == 0 && !closing && c == '/')
+                    closing = true;
+                else if (name_len == 0 && !closing && c == '?')
+                {
+                    declaration = true;             // <?xml ... ?>, does not open an element
+                    state       = state_t::attributes;
+                }
+                else if (name_len == 0 && !closing && c == '!')
+                    state = state_t::failed;        // comment, CDATA or DOCTYPE
+                else if (c == '>' || c == '/' || space(c))
+                    end_of_name(c);
+                else if (name_len < sizeof(name))
+                    name[name_len++] = c;
+                break;
+
+            case state_t::attributes:
+                if (c == '"' || c == '\'')
+                {
+                    quote = c;
+                    state = state_t::quoted;
+                }
+                else if (c == '>')
+                {
+                    state = state_t::text;
+                    if (declaration)
+                        break;
+                    if (closing)
+                        close_element();
+                    else if (!slash)
+                        open_element();
+                }
+                else if (!space(c))
+                    slash = c == '/';
+                break;
+
+            case state_t::quoted:
+                if (c == quote)
+                {
+                    slash = false;
+                    state = state_t::attributes;
+                }
+                break;
+
+            case state_t::value:
+                if (c == '<')
+                    end_of_value();
+                else if (c == '&')
+                    state = state_t::failed;
+                else if (content_len < sizeof(content))
+                    content[content_len++] = c;
+                break;
+
+            case state_t::value_end:
+                // only the closing tag may follow, no child elements
+                if (c != '/')
+                {
+                    state = state_t::failed;
+                    break;
+                }
+                state    = state_t::tag;
+                name_len = 0;
+                closing  = true;
+                break;
+
+            case state_t::complete:
+                if (!space(c))
+                    state = state_t::failed;
+                break;
+
+            case state_t::failed:
+                break;
+        }
+    }
+
+    // Skip over runs of characters without going through step(): character
+    // data, element names, attributes and outletStatN contents. Stops at the
+    // first character, that step() has to look at.
+    const char *skip(const char *p, const char *end)
+    {
+        switch (state)
+        {
+            case state_t::text:
+                if (depth == 0)
+                    break;
+                while (p != end && *p != '<' && *p != '&')
+                    p++;
+                break;
+
+            case state_t::tag:
+            {
+                // the first character of a name may start a special tag
+                if (name_len == 0 && p != end && (*p == '/' || *p == '?' || *p == '!'))
+                    break;
+                std::size_t n = name_len;   // a local copy, stores to name[] might alias a member
+                for (; p != end && *p != '>' && *p != '/' && !space(*p); p++)
+                    if (n < sizeof(name))
+                        name[n++] = *p;
+                name_len = n;
+                break;
+            }
+
+            case state_t::attributes:
+                while (p != end && *p != '"' && *p != '\'' && *p != '>')
+                {
+                    if (!space(*p))
+                        slash = *p == '/';
+                    p++;
+                }
+                break;
+
+            case state_t::quoted:
+                while (p != end && *p != quote)
+                    p++;
+                break;
+
+            case state_t::value:
+            {
+                std::size_t n = content_len;
+                for (; p != end && *p != '<' && *p != '&'; p++)
+                    if (n < sizeof(content))
+                        content[n++] = *p;
+                content_len = n;
+                break;
+            }
+
+            default:
+                break;
+        }
+        return p;
+    }
+
+public:
+    void feed(std::string_view data)
+    {
+        const char *p   = data.data();
+        const char *end = p + data.size();
+        while (p != end)
+        {
+            p = skip(p, end);
+            if (p == end)
+                return;
+            step(*p++);
+            if (state == state_t::failed)
+                return;
+        }
+    }
+
+    // the whole document has been scanned successfully
+    bool complete() const { return state == state_t::complete; }
+
+    // channels present in the document, one bit per channel
+    std::uint8_t reported() const { return reported_mask; }
+
+    // channels reported as "on"
+    std::uint8_t on() const { return on_mask; }
+};
+
+#endif /* STATUS_SCANNER_H_ */
@@ -0,0 +1,78 @@
+/*
+   power_switch: control Argus PDU SW-0816
+   Copyright (C) 2025  Mario Klebsch, DG1AM
+   
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UPSTREAM_ERROR_H_
+#define UPSTREAM_ERROR_H_
+
+#include <boost/system/error_code.hpp>
+
+// errors detected by the upstream client
+enum class upstream_error
+{
+    invalid_status_document = 1,
+    timeout,
+    circuit_open,
+    overloaded,
+};
+
+namespace boost
+{
+namespace system
+{
+template<>
+struct is_error_code_enum<upstream_error>
+{ static const bool value = true; };
+}
+}
+
+static inline boost::system::error_category& upstream_error_category()
+{
+    static class : public boost::system::error_category
+    {
+        const char * name() const BOOST_NOEXCEPT override { return "upstream_error";}
+
+        std::string message( int ev ) const override
+        {
+            switch(upstream_error(ev))
+            {
+                case upstream_error::invalid_status_document:
+                    return "invalid status document received from PDU";
+
+                case upstream_error::timeout:
+                    return "PDU did not respond in time";
+
+                case upstream_error::circuit_open:
+                    return "PDU is not reachable, circuit breaker is open";
+
+                case upstream_error::overloaded:
+                    return "too many requests waiting for the PDU";
+
+                default:
+                    return "???";
+            }
+        }
+    } instance;
+    return instance;
+}
+
+inline boost::system::error_code make_error_code(upstream_error e)
+{
+    return {int(e), upstream_error_category()};
+}
+
+#endif /* UPSTREAM_ERROR_H_ */